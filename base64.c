@@ -0,0 +1,115 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "base64.h"
+
+// the url safe alphabet is accepted too
+static int decode_sextet(unsigned char c)
+{
+    if(c >= 'A' && c <= 'Z') return c - 'A';
+    if(c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if(c >= '0' && c <= '9') return c - '0' + 52;
+    if(c == '+' || c == '-') return 62;
+    if(c == '/' || c == '_') return 63;
+    return -1;
+}
+
+#ifdef __SSE2__
+static __m128i chars_in_range(__m128i chars, char lo, char hi)
+{
+    // the comparisons are signed, so the non ascii chars are never in range
+    return _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8(lo - 1)),
+                         _mm_cmplt_epi8(chars, _mm_set1_epi8(hi + 1)));
+}
+
+// decodes 16 chars into 12 bytes, returns false when there's a char outside
+// of the standard alphabet so the scalar decoder takes care of it
+static bool decode_block_sse2(const char *src, unsigned char *dest)
+{
+    __m128i chars = _mm_loadu_si128((const __m128i *)src);
+
+    __m128i upper = chars_in_range(chars, 'A', 'Z');
+    __m128i lower = chars_in_range(chars, 'a', 'z');
+    __m128i digit = chars_in_range(chars, '0', '9');
+    __m128i plus = _mm_cmpeq_epi8(chars, _mm_set1_epi8('+'));
+    __m128i slash = _mm_cmpeq_epi8(chars, _mm_set1_epi8('/'));
+
+    __m128i valid = _mm_or_si128(_mm_or_si128(upper, lower), _mm_or_si128(_mm_or_si128(digit, plus), slash));
+    if(_mm_movemask_epi8(valid) != 0xFFFF) return false;
+
+    // every range maps to its values by adding a constant to the chars
+    __m128i offsets = _mm_or_si128(
+        _mm_or_si128(_mm_and_si128(upper, _mm_set1_epi8(-'A')),
+                     _mm_and_si128(lower, _mm_set1_epi8(26 - 'a'))),
+        _mm_or_si128(_mm_and_si128(digit, _mm_set1_epi8(52 - '0')),
+                     _mm_or_si128(_mm_and_si128(plus, _mm_set1_epi8(62 - '+')),
+                                  _mm_and_si128(slash, _mm_set1_epi8(63 - '/')))));
+    __m128i sextets = _mm_add_epi8(chars, offsets);
+
+    // joins every pair of sextets into 12 bits and every pair of those into
+    // the 24 bits of a group of 4 chars
+    __m128i pairs = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(sextets, _mm_set1_epi16(0x00FF)), 6),
+                                 _mm_srli_epi16(sextets, 8));
+    __m128i groups = _mm_or_si128(_mm_slli_epi32(_mm_and_si128(pairs, _mm_set1_epi32(0xFFFF)), 12),
+                                  _mm_srli_epi32(pairs, 16));
+
+    uint32_t words[4];
+    _mm_storeu_si128((__m128i *)words, groups);
+
+    for(int i = 0; i < 4; i++) {
+        dest[i * 3] = words[i] >> 16;
+        dest[i * 3 + 1] = words[i] >> 8;
+        dest[i * 3 + 2] = words[i];
+    }
+
+    return true;
+}
+#endif
+
+long base64_decode(const char *src, size_t len, unsigned char *dest)
+{
+    while(len > 0 && src[len - 1] == '=') len--;
+
+    size_t i = 0;
+    unsigned char *out = dest;
+
+#ifdef __SSE2__
+    while(len - i >= 16 && decode_block_sse2(src + i, out)) {
+        i += 16;
+        out += 12;
+    }
+#endif
+
+    uint32_t group = 0;
+    int group_size = 0;
+
+    for(; i < len; i++) {
+        int sextet = decode_sextet(src[i]);
+        if(sextet == -1) return -1;
+
+        group = (group << 6) | sextet;
+        if(++group_size == 4) {
+            *out++ = group >> 16;
+            *out++ = group >> 8;
+            *out++ = group;
+            group = 0;
+            group_size = 0;
+        }
+    }
+
+    // a single char left can't encode a whole byte
+    if(group_size == 1) return -1;
+
+    if(group_size == 2) {
+        *out++ = group >> 4;
+    } else if(group_size == 3) {
+        *out++ = group >> 10;
+        *out++ = group >> 2;
+    }
+
+    return out - dest;
+}
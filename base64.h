@@ -0,0 +1,14 @@
+#ifndef BASE64_H_
+#define BASE64_H_
+
+#include <stddef.h>
+
+// upper bound of the bytes decoded from len base64 chars
+#define base64_decoded_size(len) (((len) + 3) / 4 * 3)
+
+// decodes the base64 chars into dest, which should have space for at least
+// base64_decoded_size(len) bytes, the padding is optional
+// returns the number of decoded bytes, or -1 when the input isn't valid base64
+long base64_decode(const char *src, size_t len, unsigned char *dest);
+
+#endif
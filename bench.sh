@@ -0,0 +1,82 @@
+#!/bin/bash
+# generates every shape of document at every size and benchmarks it, the
+# results are written as a json array to RESULTS.json
+# usage: ./bench.sh [RESULTS.json]
+#
+# it can be tuned with these environment variables:
+#   BENCH_SHAPES   shapes generated by corpus_gen
+#   BENCH_SIZES    sizes of the documents, with K, M or G suffixes
+#   BENCH_TIMEOUT  seconds before a run is considered stuck
+#   BENCH_PORT     port of the server of the images shape
+#
+# BENCH_SHAPES=bracket-bomb BENCH_SIZES=10M is the regression benchmark of
+# the bracket scanning of the lexer, it has to stay linear
+#
+# the parse benchmark (lex + parse) always runs, the scroll benchmark (layout
+# + render + images) only runs when xvfb-run is installed
+
+SHAPES=${BENCH_SHAPES:-"paragraphs lists headings code brackets bracket-bomb images"}
+SIZES=${BENCH_SIZES:-"1K 16K 256K 4M 64M 1G"}
+TIMEOUT=${BENCH_TIMEOUT:-600}
+PORT=${BENCH_PORT:-8000}
+RESULTS=${1:-bench-results.json}
+
+./build.sh || exit 1
+
+WORK_DIR=$(mktemp -d)
+SERVER_PID=""
+
+cleanup() {
+    if [ -n "$SERVER_PID" ]; then kill "$SERVER_PID" 2>/dev/null; fi
+    rm -rf "$WORK_DIR"
+}
+trap cleanup EXIT
+
+# the images shape references 256 different images
+mkdir -p "$WORK_DIR/images"
+for i in $(seq 0 255); do
+    ./build/corpus_gen --image "$i" > "$WORK_DIR/images/image-$i.png"
+done
+python3 -m http.server "$PORT" --bind 127.0.0.1 --directory "$WORK_DIR/images" > /dev/null 2>&1 &
+SERVER_PID=$!
+
+# prints the json written by the command, or null when it failed or timed out
+run_bench() {
+    local output=$1
+    shift
+
+    rm -f "$output"
+    if timeout "$TIMEOUT" "$@" > /dev/null 2>&1 && [ -s "$output" ]; then
+        cat "$output"
+    else
+        echo "null"
+    fi
+}
+
+echo "[" > "$RESULTS"
+first=1
+
+for shape in $SHAPES; do
+    for size in $SIZES; do
+        document="$WORK_DIR/$shape-$size.md"
+        ./build/corpus_gen "$shape" "$size" "http://127.0.0.1:$PORT/" > "$document"
+
+        echo "$shape $size: parsing" >&2
+        parse=$(run_bench "$WORK_DIR/parse.json" ./build/main --bench-parse "$WORK_DIR/parse.json" "$document")
+
+        scroll="null"
+        if command -v xvfb-run > /dev/null; then
+            echo "$shape $size: scrolling" >&2
+            scroll=$(run_bench "$WORK_DIR/scroll.json" ./bench_scroll.sh "$document" "$WORK_DIR/scroll.json")
+        fi
+
+        if [ $first -eq 0 ]; then echo "," >> "$RESULTS"; fi
+        first=0
+        echo "{\"shape\": \"$shape\", \"size\": \"$size\", \"parse\": $parse, \"scroll\": $scroll}" >> "$RESULTS"
+
+        rm -f "$document"
+    done
+done
+
+echo "]" >> "$RESULTS"
+echo "results written to $RESULTS" >&2
@@ -0,0 +1,14 @@
+#!/bin/bash
+# runs the scroll benchmark under a virtual X server with software GL, so it
+# can run on machines without a display or a gpu
+# usage: ./bench_scroll.sh FILE.md [RESULTS.json]
+
+set -e
+
+if [ -z "$1" ]; then
+    echo "usage: $0 FILE.md [RESULTS.json]" >&2
+    exit 1
+fi
+
+LIBGL_ALWAYS_SOFTWARE=1 xvfb-run -a -s "-screen 0 1280x720x24" \
+    ./build/main --bench-scroll "${2:--}" "$1"
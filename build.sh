@@ -1,4 +1,19 @@
 #!/bin/bash
 
 mkdir -p build
-gcc -Wall -Werror -o ./build/main lexer.c image.c main.c -I./raylib-5.5/include -L./raylib-5.5/lib/ -l:libraylib.a -lm -lcurl
+
+# libmdrayder: the lexer and the parser without the viewer, it doesn't need raylib
+build_lib() {
+    gcc -Wall -Werror -c lexer.c -o ./build/lexer.o &&
+    gcc -Wall -Werror -c md_parser.c -o ./build/md_parser.o &&
+    ar rcs ./build/libmdrayder.a ./build/lexer.o ./build/md_parser.o
+}
+
+if [ "$1" = "lib" ]; then
+    build_lib
+    exit $?
+fi
+
+gcc -Wall -Werror -o ./build/main lexer.c md_parser.c image.c image_cache.c mpsc_queue.c stats.c scroll_bench.c base64.c telemetry.c decoder_process.c image_decode.c profiler.c trace.c html.c file_watcher.c main.c -I./raylib-5.5/include -L./raylib-5.5/lib/ -l:libraylib.a -lm -lcurl -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=strdup,--wrap=strndup "$@"
+gcc -Wall -Werror -o ./build/corpus_gen corpus_gen.c
+build_lib
@@ -0,0 +1,423 @@
+// generates synthetic markdown documents of a given size and shape, used by
+// bench.sh to find the inputs that don't scale linearly
+// usage: corpus_gen SHAPE SIZE [IMAGE_BASE_URL] > FILE.md
+//        corpus_gen --image N > image-N.png
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_IMAGE_BASE_URL "http://127.0.0.1:8000/"
+// different urls used by the images shape, the rest are repeated references
+#define IMAGES_COUNT 256
+#define LIST_MAX_DEPTH 32
+#define CODE_BLOCK_SIZE (1024 * 1024)
+#define LONG_LINE_SIZE (1024 * 1024)
+#define IMAGE_SIZE 256
+
+typedef struct Generator {
+    FILE *out;
+    size_t written;
+    size_t size;
+    uint64_t seed;
+    const char *image_base_url;
+} Generator;
+
+static const char *words[] = {
+    "lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing", "elit",
+    "sed", "do", "eiusmod", "tempor", "incididunt", "ut", "labore", "et", "dolore",
+    "magna", "aliqua", "render", "frame", "texture", "lexer", "token", "markdown",
+};
+#define WORDS_COUNT (sizeof(words) / sizeof(words[0]))
+
+// xorshift, every run with the same arguments generates the same document
+static uint64_t next_random(Generator *gen)
+{
+    gen->seed ^= gen->seed << 13;
+    gen->seed ^= gen->seed >> 7;
+    gen->seed ^= gen->seed << 17;
+    return gen->seed;
+}
+
+static size_t random_below(Generator *gen, size_t limit)
+{
+    return next_random(gen) % limit;
+}
+
+static bool is_full(Generator *gen)
+{
+    return gen->written >= gen->size;
+}
+
+static void emit(Generator *gen, const char *str)
+{
+    size_t len = strlen(str);
+    fwrite(str, 1, len, gen->out);
+    gen->written += len;
+}
+
+static void emit_char(Generator *gen, char c)
+{
+    fputc(c, gen->out);
+    gen->written++;
+}
+
+static void emit_word(Generator *gen)
+{
+    emit(gen, words[random_below(gen, WORDS_COUNT)]);
+}
+
+static void emit_sentence(Generator *gen, size_t words_count)
+{
+    for(size_t i = 0; i < words_count; i++) {
+        if(i > 0) emit_char(gen, ' ');
+        emit_word(gen);
+    }
+}
+
+// a line of text with some inline elements
+static void emit_paragraph_line(Generator *gen)
+{
+    size_t parts = 4 + random_below(gen, 8);
+
+    for(size_t i = 0; i < parts; i++) {
+        if(i > 0) emit_char(gen, ' ');
+
+        switch(random_below(gen, 10)) {
+            case 0: {
+                emit_char(gen, '*');
+                emit_sentence(gen, 2);
+                emit_char(gen, '*');
+            } break;
+            case 1: {
+                emit(gen, "**");
+                emit_sentence(gen, 2);
+                emit(gen, "**");
+            } break;
+            case 2: {
+                emit_char(gen, '`');
+                emit_word(gen);
+                emit_char(gen, '`');
+            } break;
+            case 3: {
+                emit_char(gen, '[');
+                emit_sentence(gen, 2);
+                emit(gen, "](https://example.com/");
+                emit_word(gen);
+                emit_char(gen, ')');
+            } break;
+            default: emit_sentence(gen, 3);
+        }
+    }
+    emit_char(gen, '\n');
+}
+
+static void generate_paragraphs(Generator *gen)
+{
+    while(!is_full(gen)) {
+        size_t lines = 1 + random_below(gen, 6);
+        for(size_t i = 0; i < lines; i++) emit_paragraph_line(gen);
+        emit_char(gen, '\n');
+    }
+}
+
+// lists going down to LIST_MAX_DEPTH levels and back, every level is 4 spaces
+static void generate_lists(Generator *gen)
+{
+    size_t item = 0;
+
+    while(!is_full(gen)) {
+        size_t depth = item % (LIST_MAX_DEPTH * 2);
+        if(depth >= LIST_MAX_DEPTH) depth = LIST_MAX_DEPTH * 2 - 1 - depth;
+
+        for(size_t i = 0; i < depth; i++) emit(gen, "    ");
+
+        if(item % 2 == 0) {
+            emit(gen, "* ");
+        } else {
+            char indicator[32];
+            snprintf(indicator, sizeof(indicator), "%zu. ", item + 1);
+            emit(gen, indicator);
+        }
+
+        emit_sentence(gen, 3 + random_below(gen, 5));
+        emit_char(gen, '\n');
+        item++;
+    }
+}
+
+static void generate_headings(Generator *gen)
+{
+    size_t heading = 0;
+
+    while(!is_full(gen)) {
+        size_t level = 1 + heading % 6;
+        for(size_t i = 0; i < level; i++) emit_char(gen, '#');
+
+        char title[64];
+        snprintf(title, sizeof(title), " Heading %zu ", heading);
+        emit(gen, title);
+        emit_sentence(gen, 2);
+        emit(gen, "\n\n");
+
+        // a short line so the headings aren't all together
+        if(heading % 4 == 0) {
+            emit_paragraph_line(gen);
+            emit_char(gen, '\n');
+        }
+        heading++;
+    }
+}
+
+static void generate_code_blocks(Generator *gen)
+{
+    while(!is_full(gen)) {
+        emit(gen, "```\n");
+
+        size_t block_end = gen->written + CODE_BLOCK_SIZE;
+        size_t line = 0;
+        while(gen->written < block_end && !is_full(gen)) {
+            char code[128];
+            snprintf(code, sizeof(code), "    int value_%zu = compute(%zu, ", line, line * 31 % 997);
+            emit(gen, code);
+            emit_word(gen);
+            emit(gen, ");\n");
+            line++;
+        }
+
+        emit(gen, "```\n\n");
+    }
+}
+
+// long lines full of unclosed brackets and emphasis markers
+static void generate_brackets(Generator *gen)
+{
+    while(!is_full(gen)) {
+        size_t line_end = gen->written + LONG_LINE_SIZE;
+
+        while(gen->written < line_end && !is_full(gen)) {
+            switch(random_below(gen, 4)) {
+                case 0: emit_char(gen, '['); break;
+                case 1: emit_char(gen, '*'); break;
+                case 2: emit(gen, "[a"); break;
+                default: emit_word(gen);
+            }
+        }
+
+        emit_char(gen, '\n');
+    }
+}
+
+// a single line of unclosed links, images and destinations, every one of
+// them used to scan until the end of the line
+static void generate_bracket_bomb(Generator *gen)
+{
+    while(!is_full(gen)) {
+        switch(random_below(gen, 8)) {
+            case 0: emit(gen, "!["); break;
+            case 1: emit(gen, "[a]("); break;
+            default: emit_char(gen, '[');
+        }
+    }
+
+    emit_char(gen, '\n');
+}
+
+static void generate_images(Generator *gen)
+{
+    size_t image = 0;
+
+    while(!is_full(gen)) {
+        char reference[512];
+        snprintf(reference, sizeof(reference), "![image %zu](%simage-%zu.png)\n",
+                 image, gen->image_base_url, image % IMAGES_COUNT);
+        emit(gen, reference);
+
+        emit_paragraph_line(gen);
+        emit_char(gen, '\n');
+        image++;
+    }
+}
+
+static uint32_t crc32_update(uint32_t crc, const unsigned char *data, size_t size)
+{
+    static uint32_t table[256];
+    if(table[1] == 0) {
+        for(uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for(int k = 0; k < 8; k++) c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+    }
+
+    crc = ~crc;
+    for(size_t i = 0; i < size; i++) crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void write_u32_be(unsigned char *dest, uint32_t value)
+{
+    dest[0] = value >> 24;
+    dest[1] = value >> 16;
+    dest[2] = value >> 8;
+    dest[3] = value;
+}
+
+static void write_png_chunk(FILE *out, const char *type, const unsigned char *data, uint32_t size)
+{
+    unsigned char header[8];
+    write_u32_be(header, size);
+    memcpy(header + 4, type, 4);
+
+    unsigned char crc[4];
+    write_u32_be(crc, crc32_update(crc32_update(0, header + 4, 4), data, size));
+
+    fwrite(header, 1, sizeof(header), out);
+    fwrite(data, 1, size, out);
+    fwrite(crc, 1, sizeof(crc), out);
+}
+
+// a gradient that depends on the index, stored without compression so the
+// generator doesn't need zlib
+static bool generate_image(FILE *out, unsigned int index)
+{
+    size_t row_size = 1 + IMAGE_SIZE * 3;
+    size_t raw_size = row_size * IMAGE_SIZE;
+    size_t blocks = (raw_size + 0xffff - 1) / 0xffff;
+    size_t idat_size = 2 + raw_size + blocks * 5 + 4;
+
+    unsigned char *raw = malloc(raw_size);
+    unsigned char *idat = malloc(idat_size);
+    if(raw == NULL || idat == NULL) {
+        free(raw);
+        free(idat);
+        return false;
+    }
+
+    for(size_t y = 0; y < IMAGE_SIZE; y++) {
+        unsigned char *row = raw + y * row_size;
+        row[0] = 0; // no filter
+        for(size_t x = 0; x < IMAGE_SIZE; x++) {
+            row[1 + x * 3] = x + index * 37;
+            row[2 + x * 3] = y + index * 91;
+            row[3 + x * 3] = (x ^ y) + index;
+        }
+    }
+
+    // zlib stream made of stored deflate blocks
+    size_t pos = 0;
+    idat[pos++] = 0x78;
+    idat[pos++] = 0x01;
+
+    uint32_t a = 1, b = 0;
+    for(size_t offset = 0; offset < raw_size; offset += 0xffff) {
+        size_t len = raw_size - offset < 0xffff ? raw_size - offset : 0xffff;
+
+        idat[pos++] = offset + len == raw_size;
+        idat[pos++] = len & 0xff;
+        idat[pos++] = len >> 8;
+        idat[pos++] = ~len & 0xff;
+        idat[pos++] = (~len >> 8) & 0xff;
+        memcpy(idat + pos, raw + offset, len);
+        pos += len;
+
+        for(size_t i = 0; i < len; i++) {
+            a = (a + raw[offset + i]) % 65521;
+            b = (b + a) % 65521;
+        }
+    }
+    write_u32_be(idat + pos, (b << 16) | a);
+    pos += 4;
+
+    unsigned char ihdr[13] = {0};
+    write_u32_be(ihdr, IMAGE_SIZE);
+    write_u32_be(ihdr + 4, IMAGE_SIZE);
+    ihdr[8] = 8; // bit depth
+    ihdr[9] = 2; // rgb
+
+    fwrite("\x89PNG\r\n\x1a\n", 1, 8, out);
+    write_png_chunk(out, "IHDR", ihdr, sizeof(ihdr));
+    write_png_chunk(out, "IDAT", idat, pos);
+    write_png_chunk(out, "IEND", NULL, 0);
+
+    free(raw);
+    free(idat);
+    return true;
+}
+
+typedef struct Shape {
+    const char *name;
+    void (*generate)(Generator *gen);
+} Shape;
+
+static const Shape shapes[] = {
+    { "paragraphs", generate_paragraphs },
+    { "lists", generate_lists },
+    { "headings", generate_headings },
+    { "code", generate_code_blocks },
+    { "brackets", generate_brackets },
+    { "bracket-bomb", generate_bracket_bomb },
+    { "images", generate_images },
+};
+#define SHAPES_COUNT (sizeof(shapes) / sizeof(shapes[0]))
+
+// accepts a number of bytes with an optional K, M or G suffix
+static bool parse_size(const char *str, size_t *size)
+{
+    char *end;
+    unsigned long long value = strtoull(str, &end, 10);
+    if(end == str) return false;
+
+    switch(*end) {
+        case 'K': case 'k': value *= 1024; end++; break;
+        case 'M': case 'm': value *= 1024 * 1024; end++; break;
+        case 'G': case 'g': value *= 1024 * 1024 * 1024; end++; break;
+    }
+
+    if(*end != '\0') return false;
+
+    *size = value;
+    return true;
+}
+
+static void print_usage(const char *program)
+{
+    fprintf(stderr, "usage: %s SHAPE SIZE [IMAGE_BASE_URL]\n", program);
+    fprintf(stderr, "       %s --image N\n", program);
+    fprintf(stderr, "shapes:");
+    for(size_t i = 0; i < SHAPES_COUNT; i++) fprintf(stderr, " %s", shapes[i].name);
+    fprintf(stderr, "\n");
+}
+
+int main(int argc, char **argv)
+{
+    if(argc == 3 && strcmp(argv[1], "--image") == 0) {
+        return generate_image(stdout, atoi(argv[2])) ? 0 : 1;
+    }
+
+    if(argc < 3 || argc > 4) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    const Shape *shape = NULL;
+    for(size_t i = 0; i < SHAPES_COUNT; i++) {
+        if(strcmp(shapes[i].name, argv[1]) == 0) shape = &shapes[i];
+    }
+
+    Generator gen = {
+        .out = stdout,
+        .seed = 0x9e3779b97f4a7c15ull,
+        .image_base_url = argc == 4 ? argv[3] : DEFAULT_IMAGE_BASE_URL,
+    };
+
+    if(shape == NULL || !parse_size(argv[2], &gen.size)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    shape->generate(&gen);
+
+    return 0;
+}
@@ -0,0 +1,462 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "decoder_process.h"
+
+// the input grows to fit the biggest encoded image, starting at this size
+#define DECODER_INPUT_INITIAL_SIZE (1024 * 1024)
+// address space of the children, a hostile image fails to decode instead of
+// exhausting the memory of the system, 0 disables it (sanitizers need that)
+#ifndef DECODER_MEMORY_LIMIT
+#define DECODER_MEMORY_LIMIT (2048L * 1024 * 1024)
+#endif
+// the children don't need more than their socket, their input and the memfd
+// of the image they're sending back
+#define DECODER_MAX_FDS 16
+// a child that takes longer than this to decode an image is killed, a hostile
+// image could keep it busy forever and the viewer waits for the decoder threads
+// before exiting
+#ifndef DECODER_TIMEOUT_MS
+#define DECODER_TIMEOUT_MS 10000
+#endif
+
+typedef struct DecodeRequest {
+    size_t size;
+    int target_width;
+    bool mipmaps;
+    char ext[8];
+} DecodeRequest;
+
+typedef struct DecodeResponse {
+    bool ok;
+    // size of the original image
+    int width;
+    int height;
+    // the decoded image, its pixels are sent as a memfd
+    int image_width;
+    int image_height;
+    int mipmaps;
+    int format;
+    int frames_count;
+    size_t data_size;
+} DecodeResponse;
+
+static bool map_input(DecoderProcess *process, size_t capacity)
+{
+    if(ftruncate(process->input_fd, capacity) == -1) return false;
+
+    char *input = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, process->input_fd, 0);
+    if(input == MAP_FAILED) return false;
+
+    if(process->input != NULL) munmap(process->input, process->input_capacity);
+    process->input = input;
+    process->input_capacity = capacity;
+
+    return true;
+}
+
+bool decoder_process_start(DecoderProcess *process)
+{
+    *process = (DecoderProcess){ .pid = -1, .socket = -1, .input_fd = -1 };
+
+    int sockets[2];
+    if(socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sockets) == -1) {
+        TraceLog(LOG_ERROR, "Couldn't create the socket of the decoder process: %s", strerror(errno));
+        return false;
+    }
+
+    process->socket = sockets[0];
+    process->input_fd = memfd_create("md-rayder-input", MFD_CLOEXEC);
+
+    if(process->input_fd == -1 || !map_input(process, DECODER_INPUT_INITIAL_SIZE)) {
+        TraceLog(LOG_ERROR, "Couldn't create the input of the decoder process: %s", strerror(errno));
+        close(sockets[1]);
+        decoder_process_stop(process);
+        return false;
+    }
+
+    // the arguments are built before forking, the child can only use
+    // async-signal-safe functions until it calls exec
+    char socket_arg[16], input_arg[16];
+    snprintf(socket_arg, sizeof(socket_arg), "%d", sockets[1]);
+    snprintf(input_arg, sizeof(input_arg), "%d", process->input_fd);
+    char *argv[] = { "md-rayder-decoder", DECODER_PROCESS_ARG, socket_arg, input_arg, NULL };
+
+    pid_t pid = fork();
+    if(pid == 0) {
+        fcntl(sockets[1], F_SETFD, 0);
+        fcntl(process->input_fd, F_SETFD, 0);
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0);
+
+        execv("/proc/self/exe", argv);
+        _exit(127);
+    }
+
+    close(sockets[1]);
+
+    if(pid == -1) {
+        TraceLog(LOG_ERROR, "Couldn't start the decoder process: %s", strerror(errno));
+        decoder_process_stop(process);
+        return false;
+    }
+
+    process->pid = pid;
+    return true;
+}
+
+void decoder_process_stop(DecoderProcess *process)
+{
+    // the child exits once its socket is closed
+    if(process->socket != -1) close(process->socket);
+    if(process->pid > 0) waitpid(process->pid, NULL, 0);
+
+    if(process->input != NULL) munmap(process->input, process->input_capacity);
+    if(process->input_fd != -1) close(process->input_fd);
+
+    *process = (DecoderProcess){ .pid = -1, .socket = -1, .input_fd = -1 };
+}
+
+static void log_crashed_process(DecoderProcess *process)
+{
+    int status = 0;
+    if(waitpid(process->pid, &status, 0) == process->pid && WIFSIGNALED(status)) {
+        TraceLog(LOG_WARNING, "Decoder process %d was killed by signal %d, restarting it",
+                 process->pid, WTERMSIG(status));
+    } else {
+        TraceLog(LOG_WARNING, "Decoder process %d exited, restarting it", process->pid);
+    }
+
+    // it's already reaped
+    process->pid = -1;
+}
+
+typedef enum DecodeResult {
+    DECODE_OK,
+    DECODE_INVALID,
+    DECODE_CRASHED,
+    DECODE_TIMED_OUT,
+} DecodeResult;
+
+static DecodeResult request_decode(DecoderProcess *process, DecodeRequest *request,
+                                   DecodeResponse *response, int *image_fd)
+{
+    if(send(process->socket, request, sizeof(*request), MSG_NOSIGNAL) != sizeof(*request)) {
+        return DECODE_CRASHED;
+    }
+
+    struct pollfd poll_fd = { .fd = process->socket, .events = POLLIN };
+    int ready;
+    do {
+        ready = poll(&poll_fd, 1, DECODER_TIMEOUT_MS);
+    } while(ready == -1 && errno == EINTR);
+
+    if(ready == 0) return DECODE_TIMED_OUT;
+    if(ready == -1) return DECODE_CRASHED;
+
+    // room for a few fds, the kernel closes the ones that don't fit
+    char control[CMSG_SPACE(sizeof(int) * 4)];
+    struct iovec iov = { .iov_base = response, .iov_len = sizeof(*response) };
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control,
+        .msg_controllen = sizeof(control),
+    };
+
+    ssize_t received = recvmsg(process->socket, &msg, MSG_CMSG_CLOEXEC);
+
+    // every fd the child sent is ours now, the first one is the image and
+    // the rest are closed, whatever the response says
+    *image_fd = -1;
+    if(received > 0) {
+        for(struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if(cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) continue;
+
+            size_t fds_count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for(size_t i = 0; i < fds_count; i++) {
+                int fd;
+                memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+
+                if(*image_fd == -1) {
+                    *image_fd = fd;
+                } else {
+                    close(fd);
+                }
+            }
+        }
+    }
+
+    DecodeResult result = DECODE_OK;
+    if(received != sizeof(*response)) {
+        result = DECODE_CRASHED;
+    } else if(!response->ok || *image_fd == -1) {
+        result = DECODE_INVALID;
+    }
+
+    if(result != DECODE_OK && *image_fd != -1) {
+        close(*image_fd);
+        *image_fd = -1;
+    }
+
+    return result;
+}
+
+// bytes per pixel of the formats the decoders produce, 0 for any other one
+static int get_format_bytes(int format)
+{
+    switch(format) {
+    case PIXELFORMAT_UNCOMPRESSED_GRAYSCALE: return 1;
+    case PIXELFORMAT_UNCOMPRESSED_GRAY_ALPHA: return 2;
+    case PIXELFORMAT_UNCOMPRESSED_R8G8B8: return 3;
+    case PIXELFORMAT_UNCOMPRESSED_R8G8B8A8: return 4;
+    default: return 0;
+    }
+}
+
+// a child could have been taken over by the image it decoded, so nothing in
+// its response is used until it matches the memory it sent
+static bool is_valid_response(const DecodeResponse *response, int image_fd)
+{
+    struct stat st;
+    if(fstat(image_fd, &st) == -1 || response->data_size > (size_t)st.st_size) return false;
+
+    int bytes = get_format_bytes(response->format);
+    if(bytes == 0) return false;
+    if(response->width <= 0 || response->height <= 0) return false;
+    if(response->image_width <= 0 || response->image_height <= 0) return false;
+    if(response->mipmaps < 1 || response->frames_count < 1) return false;
+    // the frames of animations have no mipmaps
+    if(response->frames_count > 1 && response->mipmaps > 1) return false;
+
+    // computed here since GetPixelDataSize overflows with huge sizes, and
+    // raylib keeps the size of every level in an int
+    size_t frame_size = 0;
+    size_t width = response->image_width;
+    size_t height = response->image_height;
+
+    for(int i = 0; i < response->mipmaps; i++) {
+        if(width * height > INT_MAX / bytes) return false;
+        frame_size += width * height * bytes;
+        if(frame_size > response->data_size) return false;
+
+        // a level after the 1x1 one doesn't exist
+        if(width == 1 && height == 1 && i < response->mipmaps - 1) return false;
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+
+    return response->data_size % frame_size == 0 &&
+           response->data_size / frame_size == (size_t)response->frames_count;
+}
+
+bool decoder_process_decode(DecoderProcess *process, const char *ext, const char *data, size_t size,
+                            int target_width, bool mipmaps, DecodedImage *decoded)
+{
+    DecodeRequest request = {
+        .size = size,
+        .target_width = target_width,
+        .mipmaps = mipmaps,
+    };
+    snprintf(request.ext, sizeof(request.ext), "%s", ext);
+
+    DecodeResponse response;
+    int image_fd = -1;
+    DecodeResult result = DECODE_CRASHED;
+
+    // the image gets a second chance in case the child crashed for another reason
+    for(int attempt = 0; attempt < 2 && result == DECODE_CRASHED; attempt++) {
+        if(process->pid == -1 && !decoder_process_start(process)) return false;
+
+        if(size > process->input_capacity) {
+            size_t capacity = process->input_capacity * 2;
+            if(capacity < size) capacity = size;
+
+            if(!map_input(process, capacity)) {
+                TraceLog(LOG_ERROR, "Couldn't grow the input of the decoder process: %s", strerror(errno));
+                return false;
+            }
+        }
+
+        memcpy(process->input, data, size);
+        result = request_decode(process, &request, &response, &image_fd);
+
+        if(result == DECODE_CRASHED) {
+            log_crashed_process(process);
+            decoder_process_stop(process);
+        }
+    }
+
+    // the image isn't tried again, it would most likely hang the new child too
+    if(result == DECODE_TIMED_OUT) {
+        TraceLog(LOG_WARNING, "Decoder process %d didn't decode the image in %d ms, restarting it",
+                 process->pid, DECODER_TIMEOUT_MS);
+        kill(process->pid, SIGKILL);
+        decoder_process_stop(process);
+        decoder_process_start(process);
+        return false;
+    }
+
+    if(result != DECODE_OK) return false;
+
+    if(!is_valid_response(&response, image_fd)) {
+        TraceLog(LOG_ERROR, "Decoder process %d sent an invalid image", process->pid);
+        close(image_fd);
+        return false;
+    }
+
+    void *pixels = mmap(NULL, response.data_size, PROT_READ | PROT_WRITE, MAP_SHARED, image_fd, 0);
+    close(image_fd);
+
+    if(pixels == MAP_FAILED) {
+        TraceLog(LOG_ERROR, "Couldn't map the decoded image: %s", strerror(errno));
+        return false;
+    }
+
+    *decoded = (DecodedImage){
+        .image = {
+            .data = pixels,
+            .width = response.image_width,
+            .height = response.image_height,
+            .mipmaps = response.mipmaps,
+            .format = response.format,
+        },
+        .frames_count = response.frames_count,
+        .width = response.width,
+        .height = response.height,
+        .mapping_size = response.data_size,
+    };
+
+    return true;
+}
+
+void decoder_process_unload_image(Image image, size_t mapping_size)
+{
+    if(image.data != NULL) munmap(image.data, mapping_size);
+}
+
+// copies the pixels into a memfd, that's the only copy, the viewer uploads
+// them straight from the mapping
+static int share_image(Image image, size_t size)
+{
+    int fd = memfd_create("md-rayder-image", MFD_CLOEXEC);
+    if(fd == -1) return -1;
+
+    void *pixels = MAP_FAILED;
+    if(ftruncate(fd, size) == 0) {
+        pixels = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+
+    if(pixels == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+
+    memcpy(pixels, image.data, size);
+    munmap(pixels, size);
+
+    return fd;
+}
+
+static void send_response(int socket, DecodeResponse *response, int image_fd)
+{
+    char control[CMSG_SPACE(sizeof(int))] = {0};
+    struct iovec iov = { .iov_base = response, .iov_len = sizeof(*response) };
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+
+    if(image_fd != -1) {
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &image_fd, sizeof(int));
+    }
+
+    sendmsg(socket, &msg, MSG_NOSIGNAL);
+}
+
+int decoder_process_main(int argc, char **argv)
+{
+    if(argc != 4) return 1;
+
+    int socket = atoi(argv[2]);
+    int input_fd = atoi(argv[3]);
+
+    // nothing else inherited from the viewer is needed
+    for(int fd = 3; fd < 1024; fd++) {
+        if(fd != socket && fd != input_fd) close(fd);
+    }
+
+    if(DECODER_MEMORY_LIMIT > 0) {
+        struct rlimit memory_limit = { DECODER_MEMORY_LIMIT, DECODER_MEMORY_LIMIT };
+        setrlimit(RLIMIT_AS, &memory_limit);
+    }
+    struct rlimit fds_limit = { DECODER_MAX_FDS, DECODER_MAX_FDS };
+    setrlimit(RLIMIT_NOFILE, &fds_limit);
+
+    char *input = NULL;
+    size_t input_size = 0;
+
+    DecodeRequest request;
+    while(recv(socket, &request, sizeof(request), 0) == sizeof(request)) {
+        DecodeResponse response = {0};
+        int image_fd = -1;
+
+        // the viewer grows the input when an image doesn't fit
+        if(request.size > input_size) {
+            if(input != NULL) munmap(input, input_size);
+
+            input = mmap(NULL, request.size, PROT_READ, MAP_SHARED, input_fd, 0);
+            input_size = request.size;
+
+            if(input == MAP_FAILED) {
+                input = NULL;
+                input_size = 0;
+                send_response(socket, &response, image_fd);
+                continue;
+            }
+        }
+
+        request.ext[sizeof(request.ext) - 1] = '\0';
+        DecodedImage decoded = decode_image(request.ext, input, request.size, request.target_width, request.mipmaps);
+        Image image = decoded.image;
+
+        if(IsImageValid(image)) {
+            response.data_size = get_decoded_image_size(&decoded);
+            image_fd = share_image(image, response.data_size);
+
+            response.ok = image_fd != -1;
+            response.width = decoded.width;
+            response.height = decoded.height;
+            response.image_width = image.width;
+            response.image_height = image.height;
+            response.mipmaps = image.mipmaps;
+            response.format = image.format;
+            response.frames_count = decoded.frames_count;
+        }
+
+        send_response(socket, &response, image_fd);
+
+        if(image_fd != -1) close(image_fd);
+        UnloadImage(image);
+    }
+
+    return 0;
+}
@@ -0,0 +1,40 @@
+#ifndef DECODER_PROCESS_H_
+#define DECODER_PROCESS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "raylib.h"
+#include "image_decode.h"
+
+// the program runs as a decoder process when it's started with this argument
+#define DECODER_PROCESS_ARG "--decoder-process"
+
+// a child process that decodes the images, so a malformed image can only
+// crash the child and not the viewer, it isn't a sandbox: the child runs with
+// no_new_privs and limits on its memory and files, but it can still make any
+// syscall the viewer can, and the viewer checks everything it sends back
+typedef struct DecoderProcess {
+    pid_t pid;
+    int socket;
+    // shared memory where the encoded bytes are written for the child
+    int input_fd;
+    char *input;
+    size_t input_capacity;
+} DecoderProcess;
+
+bool decoder_process_start(DecoderProcess *process);
+void decoder_process_stop(DecoderProcess *process);
+
+// runs decode_image in the child, a crashed child is restarted
+// on success the pixels are mapped from shared memory, and they have to be
+// released with decoder_process_unload_image instead of UnloadImage
+bool decoder_process_decode(DecoderProcess *process, const char *ext, const char *data, size_t size,
+                            int target_width, bool mipmaps, DecodedImage *decoded);
+void decoder_process_unload_image(Image image, size_t mapping_size);
+
+// entry point of the child processes
+int decoder_process_main(int argc, char **argv);
+
+#endif
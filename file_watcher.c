@@ -0,0 +1,168 @@
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "raylib.h"
+#include "trace.h"
+#include "file_watcher.h"
+
+// writes close the file, saves through a rename move a new one over it, and
+// the editors that delete the original first create it again
+#define WATCHED_EVENTS (IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO | IN_CREATE)
+
+// reads the pending events, returns whether any of them is about the file
+static bool read_events(FileWatcher *watcher)
+{
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    bool changed = false;
+
+    while(true) {
+        ssize_t length = read(watcher->inotify_fd, buf, sizeof(buf));
+        if(length <= 0) break;
+
+        for(char *ptr = buf; ptr < buf + length;) {
+            struct inotify_event *event = (struct inotify_event*)ptr;
+
+            // the events that overflowed the queue may have been about the file
+            if(event->mask & IN_Q_OVERFLOW) {
+                changed = true;
+            } else if(event->len > 0 && strcmp(event->name, watcher->name) == 0) {
+                changed = true;
+            }
+
+            ptr += sizeof(struct inotify_event) + event->len;
+        }
+    }
+
+    return changed;
+}
+
+static double get_time_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void *file_watcher_worker(void *arg)
+{
+    FileWatcher *watcher = arg;
+    trace_set_thread_name("watcher");
+
+    struct pollfd fds[2] = {
+        { .fd = watcher->inotify_fd, .events = POLLIN },
+        { .fd = watcher->stop_fd, .events = POLLIN },
+    };
+    bool pending = false;
+    double deadline = 0;
+
+    while(true) {
+        // every event about the file moves the deadline, the change is
+        // reported once the file stops changing
+        int timeout = -1;
+        if(pending) {
+            double remaining = deadline - get_time_ms();
+            timeout = remaining > 0 ? (int)remaining + 1 : 0;
+        }
+
+        int res = poll(fds, 2, timeout);
+
+        if(res < 0) {
+            if(errno == EINTR) continue;
+            TraceLog(LOG_ERROR, "WATCHER: poll failed: %s", strerror(errno));
+            break;
+        }
+
+        if(fds[1].revents & POLLIN) break;
+
+        if((fds[0].revents & POLLIN) && read_events(watcher)) {
+            pending = true;
+            deadline = get_time_ms() + FILE_WATCHER_DEBOUNCE_MS;
+            continue;
+        }
+
+        if(pending && get_time_ms() >= deadline) {
+            pending = false;
+            trace_begin("reload");
+            watcher->on_change(watcher->user_data);
+            trace_end();
+        }
+    }
+
+    return NULL;
+}
+
+bool file_watcher_start(FileWatcher *watcher, const char *path, FileWatcherCallback on_change, void *user_data)
+{
+    *watcher = (FileWatcher){ .inotify_fd = -1, .stop_fd = -1 };
+    watcher->on_change = on_change;
+    watcher->user_data = user_data;
+
+    const char *slash = strrchr(path, '/');
+    if(slash != NULL) {
+        watcher->dir = strndup(path, slash == path ? 1 : slash - path);
+        watcher->name = strdup(slash + 1);
+    } else {
+        watcher->dir = strdup(".");
+        watcher->name = strdup(path);
+    }
+
+    if(watcher->dir == NULL || watcher->name == NULL) {
+        TraceLog(LOG_ERROR, "WATCHER: Trying to allocate memory for the path");
+        goto error;
+    }
+
+    watcher->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(watcher->inotify_fd == -1) {
+        TraceLog(LOG_ERROR, "WATCHER: Couldn't initialize inotify: %s", strerror(errno));
+        goto error;
+    }
+
+    if(inotify_add_watch(watcher->inotify_fd, watcher->dir, WATCHED_EVENTS) == -1) {
+        TraceLog(LOG_ERROR, "WATCHER: Couldn't watch %s: %s", watcher->dir, strerror(errno));
+        goto error;
+    }
+
+    watcher->stop_fd = eventfd(0, EFD_CLOEXEC);
+    if(watcher->stop_fd == -1) {
+        TraceLog(LOG_ERROR, "WATCHER: Couldn't create the eventfd: %s", strerror(errno));
+        goto error;
+    }
+
+    if(pthread_create(&watcher->thread, NULL, file_watcher_worker, watcher) != 0) {
+        TraceLog(LOG_ERROR, "WATCHER: Couldn't start the thread");
+        goto error;
+    }
+
+    watcher->running = true;
+    TraceLog(LOG_INFO, "WATCHER: Watching %s", path);
+    return true;
+
+error:
+    file_watcher_stop(watcher);
+    return false;
+}
+
+void file_watcher_stop(FileWatcher *watcher)
+{
+    if(watcher->running) {
+        uint64_t value = 1;
+        if(write(watcher->stop_fd, &value, sizeof(value)) != sizeof(value)) {
+            TraceLog(LOG_WARNING, "WATCHER: Couldn't wake up the thread: %s", strerror(errno));
+        }
+        pthread_join(watcher->thread, NULL);
+    }
+
+    if(watcher->inotify_fd != -1) close(watcher->inotify_fd);
+    if(watcher->stop_fd != -1) close(watcher->stop_fd);
+    free(watcher->dir);
+    free(watcher->name);
+
+    *watcher = (FileWatcher){ .inotify_fd = -1, .stop_fd = -1 };
+}
@@ -0,0 +1,33 @@
+#ifndef FILE_WATCHER_H_
+#define FILE_WATCHER_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+
+// the file has to stay quiet this long before the change is reported, editors
+// write a file in several steps and we only want to reload it once
+#define FILE_WATCHER_DEBOUNCE_MS 150
+
+typedef void (*FileWatcherCallback)(void *user_data);
+
+// watches a file with inotify from its own thread, the directory is watched
+// instead of the file so the editors that save by writing a temporary file and
+// renaming it over the original one keep being followed
+typedef struct FileWatcher {
+    pthread_t thread;
+    int inotify_fd;
+    int stop_fd; // an eventfd that wakes up the thread to stop it
+    char *dir;
+    char *name;
+    FileWatcherCallback on_change;
+    void *user_data;
+    bool running;
+} FileWatcher;
+
+// the callback is called from the thread of the watcher, a slow callback only
+// delays the next change, a watcher that fails to start is already cleaned up
+bool file_watcher_start(FileWatcher *watcher, const char *path, FileWatcherCallback on_change, void *user_data);
+// only for watchers that were started successfully
+void file_watcher_stop(FileWatcher *watcher);
+
+#endif
@@ -0,0 +1,607 @@
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "raylib.h"
+#include "lexer.h"
+#include "md_parser.h"
+#include "html.h"
+
+// buffers the output of a file so it's written in big blocks
+typedef struct HtmlWriter {
+    int fd;
+    char buf[HTML_WRITER_BUFFER_SIZE];
+    size_t size;
+    bool failed;
+    int error; // errno of the failed write
+} HtmlWriter;
+
+typedef struct HtmlList {
+    int depth; // indentation of its items
+    bool ordered;
+} HtmlList;
+
+enum HtmlBlock {
+    HTML_BLOCK_NONE, // at the start of a line
+    HTML_BLOCK_PARAGRAPH,
+    HTML_BLOCK_HEADING,
+    HTML_BLOCK_LIST_ITEM,
+};
+
+// the state of the document while the parser walks it, every line is a block
+// like the viewer draws it
+typedef struct HtmlDocument {
+    HtmlWriter writer;
+    enum HtmlBlock block;
+    int heading_level;
+    int indent; // indentation of the current line
+    // the open lists, the item of every one of them is still open so the
+    // nested lists end up inside of it
+    HtmlList lists[HTML_MAX_LIST_DEPTH];
+    int lists_count;
+} HtmlDocument;
+
+typedef struct HtmlFile {
+    char *input_path;
+    char *output_path;
+} HtmlFile;
+
+typedef struct HtmlFiles {
+    HtmlFile *items;
+    size_t count;
+    size_t capacity;
+} HtmlFiles;
+
+typedef struct HtmlJob {
+    HtmlFiles files;
+    // index of the next file to convert, the workers take them in order
+    atomic_size_t next;
+    atomic_size_t converted;
+    atomic_size_t bytes;
+} HtmlJob;
+
+static void writer_write_all(HtmlWriter *writer, const char *data, size_t size)
+{
+    while(size > 0 && !writer->failed) {
+        ssize_t res = write(writer->fd, data, size);
+
+        if(res < 0) {
+            if(errno == EINTR) continue;
+            writer->failed = true;
+            writer->error = errno;
+        } else {
+            data += res;
+            size -= res;
+        }
+    }
+}
+
+static void writer_flush(HtmlWriter *writer)
+{
+    writer_write_all(writer, writer->buf, writer->size);
+    writer->size = 0;
+}
+
+static void writer_write(HtmlWriter *writer, const char *data, size_t size)
+{
+    if(writer->size + size > HTML_WRITER_BUFFER_SIZE) {
+        writer_flush(writer);
+
+        // it wouldn't fit in the buffer anyway, it's written directly
+        if(size > HTML_WRITER_BUFFER_SIZE) {
+            writer_write_all(writer, data, size);
+            return;
+        }
+    }
+
+    memcpy(writer->buf + writer->size, data, size);
+    writer->size += size;
+}
+
+static void writer_puts(HtmlWriter *writer, const char *str)
+{
+    writer_write(writer, str, strlen(str));
+}
+
+// writes the text escaping the characters that have a meaning in html, the
+// runs of plain characters are copied at once
+static void writer_write_escaped(HtmlWriter *writer, MDSlice text)
+{
+    size_t run_start = 0;
+
+    for(size_t i = 0; i < text.size; i++) {
+        const char *entity = NULL;
+
+        switch(text.data[i]) {
+            case '&': entity = "&amp;"; break;
+            case '<': entity = "&lt;"; break;
+            case '>': entity = "&gt;"; break;
+            case '"': entity = "&quot;"; break;
+            default: continue;
+        }
+
+        writer_write(writer, text.data + run_start, i - run_start);
+        writer_puts(writer, entity);
+        run_start = i + 1;
+    }
+
+    writer_write(writer, text.data + run_start, text.size - run_start);
+}
+
+static void close_lists(HtmlDocument *doc, int count)
+{
+    while(doc->lists_count > count) {
+        HtmlList *list = &doc->lists[--doc->lists_count];
+        writer_puts(&doc->writer, list->ordered ? "</li></ol>\n" : "</li></ul>\n");
+    }
+}
+
+static void end_block(HtmlDocument *doc)
+{
+    HtmlWriter *writer = &doc->writer;
+
+    switch(doc->block) {
+        case HTML_BLOCK_PARAGRAPH:
+            writer_puts(writer, "</p>\n");
+            break;
+        case HTML_BLOCK_HEADING: {
+            char tag[8];
+            int length = snprintf(tag, sizeof(tag), "</h%d>\n", doc->heading_level);
+            writer_write(writer, tag, length);
+        } break;
+        // the item is closed with its list or when the next one starts
+        case HTML_BLOCK_LIST_ITEM:
+        case HTML_BLOCK_NONE:
+            break;
+    }
+
+    doc->block = HTML_BLOCK_NONE;
+}
+
+// the lines that aren't headings nor list items are paragraphs
+static void begin_inline(HtmlDocument *doc)
+{
+    if(doc->block != HTML_BLOCK_NONE) return;
+
+    close_lists(doc, 0);
+    writer_puts(&doc->writer, "<p>");
+    doc->block = HTML_BLOCK_PARAGRAPH;
+}
+
+static void on_heading(void *user_data, int level)
+{
+    HtmlDocument *doc = user_data;
+
+    end_block(doc);
+    close_lists(doc, 0);
+
+    if(level < 1) level = 1;
+    if(level > 6) level = 6;
+
+    char tag[8];
+    int length = snprintf(tag, sizeof(tag), "<h%d>", level);
+    writer_write(&doc->writer, tag, length);
+
+    doc->heading_level = level;
+    doc->block = HTML_BLOCK_HEADING;
+}
+
+static void on_text(void *user_data, MDTextStyle style, MDSlice text)
+{
+    HtmlDocument *doc = user_data;
+    HtmlWriter *writer = &doc->writer;
+
+    begin_inline(doc);
+
+    if(style.bold) writer_puts(writer, "<strong>");
+    if(style.italic) writer_puts(writer, "<em>");
+    if(style.code) writer_puts(writer, "<code>");
+
+    writer_write_escaped(writer, text);
+
+    if(style.code) writer_puts(writer, "</code>");
+    if(style.italic) writer_puts(writer, "</em>");
+    if(style.bold) writer_puts(writer, "</strong>");
+}
+
+static void on_link(void *user_data, MDSlice text, MDSlice dest)
+{
+    HtmlDocument *doc = user_data;
+    HtmlWriter *writer = &doc->writer;
+
+    begin_inline(doc);
+
+    if(dest.size == 0) {
+        writer_write_escaped(writer, text);
+        return;
+    }
+
+    writer_puts(writer, "<a href=\"");
+    writer_write_escaped(writer, dest);
+    writer_puts(writer, "\">");
+    writer_write_escaped(writer, text);
+    writer_puts(writer, "</a>");
+}
+
+static void on_image(void *user_data, MDSlice alt, MDSlice url)
+{
+    HtmlDocument *doc = user_data;
+    HtmlWriter *writer = &doc->writer;
+
+    begin_inline(doc);
+
+    writer_puts(writer, "<img src=\"");
+    writer_write_escaped(writer, url);
+    writer_puts(writer, "\" alt=\"");
+    writer_write_escaped(writer, alt);
+    writer_puts(writer, "\">");
+}
+
+static void on_code_block(void *user_data, MDSlice code)
+{
+    HtmlDocument *doc = user_data;
+
+    end_block(doc);
+    close_lists(doc, 0);
+
+    writer_puts(&doc->writer, "<pre><code>");
+    writer_write_escaped(&doc->writer, code);
+    writer_puts(&doc->writer, "</code></pre>\n");
+}
+
+static void on_newline(void *user_data)
+{
+    HtmlDocument *doc = user_data;
+
+    end_block(doc);
+    doc->indent = 0;
+}
+
+// number of the first item of an ordered list, its indicator is the digits
+// followed by a dot
+static long get_list_start(MDSlice indicator)
+{
+    long start = 0;
+
+    for(size_t i = 0; i < indicator.size && isdigit((unsigned char)indicator.data[i]); i++) {
+        start = start * 10 + (indicator.data[i] - '0');
+        if(start > INT_MAX) return INT_MAX;
+    }
+
+    return start;
+}
+
+static void on_list_item(void *user_data, bool ordered, MDSlice indicator)
+{
+    HtmlDocument *doc = user_data;
+    HtmlWriter *writer = &doc->writer;
+    int depth = doc->indent;
+
+    end_block(doc);
+
+    while(doc->lists_count > 0) {
+        HtmlList *top = &doc->lists[doc->lists_count - 1];
+
+        if(top->depth > depth || (top->depth == depth && top->ordered != ordered)) {
+            close_lists(doc, doc->lists_count - 1);
+        } else {
+            break;
+        }
+    }
+
+    HtmlList *top = doc->lists_count > 0 ? &doc->lists[doc->lists_count - 1] : NULL;
+
+    if(top != NULL && (top->depth == depth || doc->lists_count == HTML_MAX_LIST_DEPTH)) {
+        writer_puts(writer, "</li>\n<li>");
+    } else {
+        doc->lists[doc->lists_count++] = (HtmlList){ depth, ordered };
+
+        long start = ordered ? get_list_start(indicator) : 1;
+        if(start != 1) {
+            char tag[32];
+            snprintf(tag, sizeof(tag), "\n<ol start=\"%ld\">\n<li>", start);
+            writer_puts(writer, tag);
+        } else {
+            writer_puts(writer, ordered ? "\n<ol>\n<li>" : "\n<ul>\n<li>");
+        }
+    }
+
+    doc->block = HTML_BLOCK_LIST_ITEM;
+}
+
+static void on_indent(void *user_data)
+{
+    HtmlDocument *doc = user_data;
+
+    if(doc->block == HTML_BLOCK_NONE) {
+        doc->indent++;
+    }
+}
+
+static const MDCallbacks html_callbacks = {
+    .on_heading = on_heading,
+    .on_text = on_text,
+    .on_link = on_link,
+    .on_image = on_image,
+    .on_code_block = on_code_block,
+    .on_newline = on_newline,
+    .on_list_item = on_list_item,
+    .on_indent = on_indent,
+};
+
+// creates the parent directories of the path, the workers may race creating
+// the same one so the existing ones are fine
+static bool make_parent_dirs(const char *path)
+{
+    char *dir = strdup(path);
+    if(dir == NULL) return false;
+
+    for(char *c = dir + 1; *c != '\0'; c++) {
+        if(*c != '/') continue;
+
+        *c = '\0';
+        if(mkdir(dir, 0755) == -1 && errno != EEXIST) {
+            TraceLog(LOG_ERROR, "Couldn't create the directory %s: %s", dir, strerror(errno));
+            free(dir);
+            return false;
+        }
+        *c = '/';
+    }
+
+    free(dir);
+    return true;
+}
+
+static bool convert_file(HtmlFile *file, HtmlDocument *doc, size_t *bytes)
+{
+    int input_fd = open(file->input_path, O_RDONLY);
+    if(input_fd == -1) {
+        TraceLog(LOG_ERROR, "Couldn't open %s: %s", file->input_path, strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if(fstat(input_fd, &st) == -1) {
+        TraceLog(LOG_ERROR, "Couldn't stat %s: %s", file->input_path, strerror(errno));
+        close(input_fd);
+        return false;
+    }
+
+    // the document is parsed straight from the mapping, the text reaches the
+    // output without being copied anywhere else
+    size_t size = st.st_size;
+    const char *buf = "";
+    if(size > 0) {
+        buf = mmap(NULL, size, PROT_READ, MAP_PRIVATE, input_fd, 0);
+        if(buf == MAP_FAILED) {
+            TraceLog(LOG_ERROR, "Couldn't map %s: %s", file->input_path, strerror(errno));
+            close(input_fd);
+            return false;
+        }
+        madvise((void*)buf, size, MADV_SEQUENTIAL);
+    }
+    close(input_fd);
+
+    bool success = false;
+    int output_fd = -1;
+
+    if(!make_parent_dirs(file->output_path)) goto cleanup;
+
+    output_fd = open(file->output_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(output_fd == -1) {
+        TraceLog(LOG_ERROR, "Couldn't create %s: %s", file->output_path, strerror(errno));
+        goto cleanup;
+    }
+
+    doc->writer.fd = output_fd;
+    doc->writer.size = 0;
+    doc->writer.failed = false;
+    doc->block = HTML_BLOCK_NONE;
+    doc->indent = 0;
+    doc->lists_count = 0;
+
+    HtmlWriter *writer = &doc->writer;
+    const char *name = strrchr(file->input_path, '/');
+    name = name ? name + 1 : file->input_path;
+
+    writer_puts(writer, "<!DOCTYPE html>\n<html>\n<head>\n<meta charset=\"utf-8\">\n<title>");
+    writer_write_escaped(writer, (MDSlice){ name, strlen(name) });
+    writer_puts(writer, "</title>\n</head>\n<body>\n");
+
+    md_parse(buf, size, &html_callbacks, doc);
+    end_block(doc);
+    close_lists(doc, 0);
+
+    writer_puts(writer, "</body>\n</html>\n");
+    writer_flush(writer);
+
+    if(writer->failed) {
+        TraceLog(LOG_ERROR, "Couldn't write %s: %s", file->output_path, strerror(writer->error));
+        goto cleanup;
+    }
+
+    *bytes = size;
+    success = true;
+
+cleanup:
+    if(output_fd != -1) close(output_fd);
+    if(size > 0) munmap((void*)buf, size);
+    return success;
+}
+
+static void *html_worker(void *arg)
+{
+    HtmlJob *job = arg;
+    // the document holds the buffer of the writer, it's too big for the stack
+    HtmlDocument *doc = malloc(sizeof(HtmlDocument));
+
+    if(doc == NULL) {
+        TraceLog(LOG_ERROR, "Trying to allocate memory for the html writer");
+        return NULL;
+    }
+
+    while(true) {
+        size_t i = atomic_fetch_add(&job->next, 1);
+        if(i >= job->files.count) break;
+
+        size_t bytes = 0;
+        if(convert_file(&job->files.items[i], doc, &bytes)) {
+            atomic_fetch_add(&job->converted, 1);
+            atomic_fetch_add(&job->bytes, bytes);
+        }
+    }
+
+    free(doc);
+    return NULL;
+}
+
+static char *join_path(const char *dir, const char *name)
+{
+    size_t length = strlen(dir) + strlen(name) + 2;
+    char *path = malloc(length);
+    if(path == NULL) return NULL;
+
+    snprintf(path, length, "%s/%s", dir, name);
+    return path;
+}
+
+static bool has_md_extension(const char *name)
+{
+    size_t length = strlen(name);
+    return length > 3 && strcmp(name + length - 3, ".md") == 0;
+}
+
+// collects the .md files of the directory, the output path keeps the same
+// relative path with the extension changed to .html
+static bool collect_files(const char *input_dir, const char *output_dir, HtmlFiles *files)
+{
+    DIR *dir = opendir(input_dir);
+    if(dir == NULL) {
+        TraceLog(LOG_ERROR, "Couldn't open the directory %s: %s", input_dir, strerror(errno));
+        return false;
+    }
+
+    bool success = true;
+    struct dirent *entry;
+
+    while(success && (entry = readdir(dir)) != NULL) {
+        const char *name = entry->d_name;
+        if(name[0] == '.') continue;
+
+        char *input_path = join_path(input_dir, name);
+        char *output_path = join_path(output_dir, name);
+        if(input_path == NULL || output_path == NULL) {
+            TraceLog(LOG_ERROR, "Trying to allocate memory for a path");
+            free(input_path);
+            free(output_path);
+            success = false;
+            break;
+        }
+
+        // links are followed to files only, a link to a parent directory
+        // would make us recurse forever, st ends up describing the target
+        struct stat st;
+        if(lstat(input_path, &st) == -1) {
+            TraceLog(LOG_WARNING, "Couldn't stat %s: %s", input_path, strerror(errno));
+        } else if(S_ISDIR(st.st_mode)) {
+            success = collect_files(input_path, output_path, files);
+        } else if(S_ISLNK(st.st_mode) && stat(input_path, &st) == 0 && S_ISDIR(st.st_mode)) {
+            TraceLog(LOG_INFO, "Skipping %s, symlinked directories aren't followed", input_path);
+        } else if(S_ISREG(st.st_mode) && has_md_extension(name)) {
+            // .md -> .html, the buffer of the path has room for the 2 extra chars
+            size_t length = strlen(output_path);
+            char *html_path = realloc(output_path, length + 3);
+            if(html_path != NULL) {
+                strcpy(html_path + length - 3, ".html");
+                da_append(files, ((HtmlFile){ input_path, html_path }));
+                continue;
+            }
+            success = false;
+        }
+
+        free(input_path);
+        free(output_path);
+    }
+
+    closedir(dir);
+    return success;
+}
+
+static double get_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+bool html_convert_directory(const char *input_dir, const char *output_dir)
+{
+    HtmlJob job = {0};
+    bool success = false;
+    double start = get_seconds();
+
+    if(!collect_files(input_dir, output_dir, &job.files)) {
+        goto cleanup;
+    }
+
+    if(job.files.count == 0) {
+        TraceLog(LOG_WARNING, "There are no .md files in %s", input_dir);
+        goto cleanup;
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t workers_count = cpus > 0 ? cpus : 1;
+    if(workers_count > job.files.count) workers_count = job.files.count;
+
+    pthread_t *workers = malloc(sizeof(pthread_t) * workers_count);
+    if(workers == NULL) {
+        TraceLog(LOG_ERROR, "Trying to allocate memory for the html workers");
+        goto cleanup;
+    }
+
+    size_t started = 0;
+    for(; started < workers_count; started++) {
+        if(pthread_create(&workers[started], NULL, html_worker, &job) != 0) {
+            TraceLog(LOG_WARNING, "Couldn't start an html worker, using %zu", started);
+            break;
+        }
+    }
+
+    // without workers the files are converted by this thread
+    if(started == 0) html_worker(&job);
+
+    for(size_t i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+
+    double elapsed = get_seconds() - start;
+    size_t converted = atomic_load(&job.converted);
+    double mb = atomic_load(&job.bytes) / (1024.0 * 1024.0);
+
+    TraceLog(LOG_INFO, "HTML: converted %zu files (%.2f MB) in %.3f s with %zu workers",
+             converted, mb, elapsed, started ? started : 1);
+    TraceLog(LOG_INFO, "HTML: %.1f files/s, %.1f MB/s",
+             elapsed > 0 ? converted / elapsed : 0, elapsed > 0 ? mb / elapsed : 0);
+    success = converted == job.files.count;
+
+cleanup:
+    for(size_t i = 0; i < job.files.count; i++) {
+        free(job.files.items[i].input_path);
+        free(job.files.items[i].output_path);
+    }
+    da_free(&job.files);
+
+    return success;
+}
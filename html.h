@@ -0,0 +1,16 @@
+#ifndef HTML_H_
+#define HTML_H_
+
+#include <stdbool.h>
+
+// size of the buffer of every file being written
+#define HTML_WRITER_BUFFER_SIZE (64 * 1024)
+// deeper lists are written at this level
+#define HTML_MAX_LIST_DEPTH 32
+
+// converts every .md file inside the input directory, and its subdirectories,
+// to an .html file with the same relative path inside the output directory,
+// the files are converted in parallel, one worker per cpu
+bool html_convert_directory(const char *input_dir, const char *output_dir);
+
+#endif
@@ -1,33 +1,400 @@
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
 #include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <curl/curl.h>
 
 #include "raylib.h"
 #include "raymath.h"
+#include "rlgl.h"
+#include "lexer.h"
 #include "image.h"
+#include "image_cache.h"
+#include "mpsc_queue.h"
+#include "base64.h"
+#include "telemetry.h"
+#include "trace.h"
+#include "decoder_process.h"
+#include "image_decode.h"
 
-pthread_mutex_t mutex_lock;
+// maximum number of simultaneous connections opened against the same host
+#define MAX_HOST_CONNECTIONS 6
+#define MAX_TOTAL_CONNECTIONS 64
+#define MAX_DECODE_WORKERS 8
+// transfers running at the same time, the rest wait sorted by their distance
+// to the viewport so the visible images are downloaded first
+#define MAX_ACTIVE_TRANSFERS 16
+// transfers of images farther than this from the viewport (in pixels) get
+// cancelled when there are closer images waiting
+#define CANCEL_MIN_DISTANCE 4000
+// first allocation of the download buffer when the server doesn't send a
+// Content-Length, it doubles every time it gets full
+#define DOWNLOAD_BUFFER_INITIAL_SIZE (16 * 1024)
+// we stop looking for the size in the header of a download after this many bytes
+#define PROBE_MAX_BYTES (256 * 1024)
+// urls longer than this are cut in the logs, inline images can take megabytes
+#define LOG_URL_MAX 256
+// initial number of buckets of the image registry, it doubles when it gets full
+#define REGISTRY_INITIAL_BUCKETS 256
+// time the render thread can spend uploading textures each frame
+#define UPLOAD_BUDGET_MS 4.0
+// the textures are uploaded in bands of rows of about this size, so a big
+// image doesn't blow the budget of the frame
+#define UPLOAD_STEP_BYTES (1024 * 1024)
+#define IMAGE_PLACEHOLDER_COLOR CLITERAL(Color){20, 21, 31, 255}
+// how long the downloader sleeps waiting for socket activity when idle
+#define DOWNLOADER_POLL_TIMEOUT_MS 1000
+// when we have a cached copy we don't wait long for the server, so an
+// unreachable network doesn't stall the rendering of the cached images
+#define REVALIDATION_CONNECT_TIMEOUT_MS 2000
 
-static size_t write_memory_callback(void *contents, size_t size, size_t nmemb, void *chunk)
+typedef struct ImageQueue {
+    ImageEntry **items;
+    size_t count;
+    size_t capacity;
+} ImageQueue;
+
+// the disk cache work of a downloaded image, it's done by the decoders so the
+// downloader only waits for the network
+enum CacheStep {
+    CACHE_NONE,
+    // decode the cached copy when it's fresh, otherwise fetch the image
+    CACHE_LOOKUP,
+    // store the downloaded bytes before decoding them
+    CACHE_STORE,
+    // the server revalidated the cached copy, its metadata is updated and it's decoded
+    CACHE_REFRESH,
+    // the revalidation failed, the stale copy is decoded anyway
+    CACHE_READ,
+};
+
+typedef struct DecodeJob {
+    ImageEntry *entry;
+    ImageChunk chunk;
+    size_t chunk_capacity;
+    CURL *curl_handle;
+    struct curl_slist *headers;
+    // true when the request is a conditional one against a stale cache entry
+    bool revalidating;
+    CacheMetadata cached_meta;
+    CacheMetadata meta;
+    // the chunk is the source of the entry and must not be freed after decoding
+    bool keep_data;
+    // the chunk is mapped from a local file by the decoder and unmapped after decoding
+    bool mapped;
+    // the chunk is decoded by the decoder from the base64 of a data url
+    bool embedded;
+    enum CacheStep cache;
+    // true once the size of the image was read from its header
+    bool probed;
+    // set by the progress callback when the transfer is aborted to make room
+    // for a closer image
+    bool cancelled;
+} DecodeJob;
+
+// an image the decoders didn't find fresh in the disk cache, it goes back to
+// the downloader to be fetched
+typedef struct FetchRequest {
+    ImageEntry *entry;
+    // the stale copy is revalidated instead of downloaded again
+    bool revalidate;
+    CacheMetadata cached_meta;
+} FetchRequest;
+
+typedef struct FetchList {
+    FetchRequest **items;
+    size_t count;
+    size_t capacity;
+} FetchList;
+
+typedef struct LoadRequest {
+    ImageEntry *entry;
+    int priority;
+    size_t order; // the order in which it was requested breaks the ties
+    FetchRequest *fetch; // NULL until the disk cache was checked
+} LoadRequest;
+
+// binary min-heap of the images waiting to be loaded, keyed by their distance
+// to the viewport
+typedef struct LoadQueue {
+    LoadRequest *items;
+    size_t count;
+    size_t capacity;
+} LoadQueue;
+
+typedef struct TransferList {
+    DecodeJob **items;
+    size_t count;
+    size_t capacity;
+} TransferList;
+
+typedef struct DecodeQueue {
+    DecodeJob *items;
+    size_t count;
+    size_t capacity;
+} DecodeQueue;
+
+typedef struct ImageLoader {
+    atomic_bool running;
+
+    CURLM *multi;
+    pthread_t downloader;
+    // images waiting to be added to the multi handle, filled by the render thread
+    MPSCQueue pending;
+    // transfers currently added to the multi handle, only touched by the downloader
+    TransferList transfers;
+    // images popped from the pending queue that don't have a transfer yet
+    LoadQueue waiting;
+    // bumped by the render thread when the priorities of the images change
+    atomic_uint priorities_generation;
+    // priority of the closest waiting image
+    int best_waiting_priority;
+    atomic_size_t requests_count;
+    size_t max_download_size;
+    // only touched by the downloader
+    size_t downloaded_bytes;
+    size_t buffer_reallocs;
+
+    pthread_t decoders[MAX_DECODE_WORKERS];
+    size_t decoders_count;
+    // when enabled every decoder thread sends its images to its own process
+    bool isolated;
+    // the images are decoded at most as wide as the window, so they're only
+    // drawn smaller than their texture after the window shrinks, the mipmaps
+    // keep them smooth then at the cost of a third more memory and slower uploads
+    bool mipmaps;
+    DecoderProcess processes[MAX_DECODE_WORKERS];
+    // NOTE: the render thread never takes this lock, it's only shared by the
+    // downloader and the decoders
+    pthread_mutex_t decode_lock;
+    pthread_cond_t decode_cond;
+    // completed downloads waiting to be decoded
+    DecodeQueue decode;
+    // images missing from the disk cache, they're picked up by the downloader
+    FetchList fetches;
+
+    // used to measure how long it takes to load a batch of images
+    atomic_size_t in_flight;
+    atomic_size_t batch_count;
+    _Atomic double batch_start;
+
+    // decoded images waiting to be picked up by the render thread
+    MPSCQueue completed;
+
+    // width at which the images are displayed, wider images are downscaled to
+    // this size by the decoders
+    _Atomic int target_width;
+
+    // directory of the document, used to resolve the relative image paths
+    char *base_dir;
+} ImageLoader;
+
+typedef struct ResidentImages {
+    ImageEntry **items;
+    size_t count;
+    size_t capacity;
+} ResidentImages;
+
+// keeps track of the memory used by the decoded images and their textures,
+// only used by the render thread
+typedef struct TextureManager {
+    size_t budget;
+    size_t used;
+    unsigned long frame;
+    ResidentImages resident;
+    // decoded images waiting for their texture to be uploaded
+    ImageQueue uploads;
+    // the texture being uploaded a few rows per frame, it's finished before
+    // another one is started
+    ImageEntry *uploading;
+    Texture2D partial_texture;
+    int uploaded_rows;
+    // moving average of the time of an upload step, a step that wouldn't fit
+    // in the budget left waits for the next frame
+    double upload_step_ms;
+    // uploaded animated images, only the ones on the screen advance
+    ImageQueue animations;
+    // the distance to the viewport of a loading image changed in the last frame
+    bool priorities_changed;
+} TextureManager;
+
+// maps every url to its shared entry, only used by the render thread
+typedef struct ImageRegistry {
+    ImageEntry **buckets;
+    size_t buckets_count;
+    size_t entries_count;
+    // number of image nodes referencing the entries
+    size_t refs_count;
+    // released entries the loader is still working on, they get freed once
+    // their load finishes
+    ImageQueue orphans;
+} ImageRegistry;
+
+static ImageLoader loader = {0};
+static ImageRegistry registry = {0};
+// the frame starts at 1 so images that were never drawn aren't visible
+static TextureManager textures = { .frame = 1 };
+
+static double get_time_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static uint32_t read_u16_be(const unsigned char *p) { return (p[0] << 8) | p[1]; }
+static uint32_t read_u16_le(const unsigned char *p) { return p[0] | (p[1] << 8); }
+static uint32_t read_u32_be(const unsigned char *p) { return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]; }
+static uint32_t read_u32_le(const unsigned char *p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24); }
+
+static bool probe_jpeg_size(const unsigned char *data, size_t size, int *width, int *height)
+{
+    // after the SOI marker the file is a list of segments, the frame header
+    // (SOF) has the size of the image
+    size_t pos = 2;
+    while(pos + 9 <= size) {
+        if(data[pos] != 0xFF) return false;
+
+        unsigned char marker = data[pos + 1];
+        if(marker == 0xFF) {
+            pos++;
+            continue;
+        }
+
+        bool is_sof = marker >= 0xC0 && marker <= 0xCF
+                      && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+        if(is_sof) {
+            *height = read_u16_be(data + pos + 5);
+            *width = read_u16_be(data + pos + 7);
+            return true;
+        }
+
+        pos += 2 + read_u16_be(data + pos + 2);
+    }
+
+    return false;
+}
+
+static void set_image_size(ImageEntry *entry, int width, int height)
+{
+    // the width is published last, a non zero width means the size is known
+    atomic_store_explicit(&entry->height, height, memory_order_relaxed);
+    atomic_store_explicit(&entry->width, width, memory_order_release);
+}
+
+// reads the size of the image from the header of the file, so we know how
+// much space the image takes before it's fully downloaded and decoded
+static bool probe_image_size(const char *buf, size_t size, int *width, int *height)
+{
+    const unsigned char *data = (const unsigned char *)buf;
+
+    if(size >= 24 && memcmp(data, "\x89PNG\r\n\x1a\n", 8) == 0 && memcmp(data + 12, "IHDR", 4) == 0) {
+        *width = read_u32_be(data + 16);
+        *height = read_u32_be(data + 20);
+    } else if(size >= 10 && (memcmp(data, "GIF87a", 6) == 0 || memcmp(data, "GIF89a", 6) == 0)) {
+        *width = read_u16_le(data + 6);
+        *height = read_u16_le(data + 8);
+    } else if(size >= 26 && memcmp(data, "BM", 2) == 0) {
+        *width = (int32_t)read_u32_le(data + 18);
+        // the height is negative for top-down bitmaps
+        *height = abs((int32_t)read_u32_le(data + 22));
+    } else if(size >= 4 && data[0] == 0xFF && data[1] == 0xD8) {
+        if(!probe_jpeg_size(data, size, width, height)) return false;
+    } else {
+        return false;
+    }
+
+    return *width > 0 && *height > 0;
+}
+
+
+static size_t write_memory_callback(void *contents, size_t size, size_t nmemb, void *arg)
 {
     size_t real_size = size * nmemb;
-    ImageChunk *image_chunk = (ImageChunk *)chunk;
+    DecodeJob *job = (DecodeJob *)arg;
+    ImageChunk *image_chunk = &job->chunk;
 
-    char *ptr = realloc(image_chunk->data, image_chunk->size + real_size + 1);
-    if(!ptr) {
-        TraceLog(LOG_ERROR, "Error trying to reallocate memory for the image chunk");
+    size_t needed = image_chunk->size + real_size;
+    if(needed > loader.max_download_size) {
+        TraceLog(LOG_ERROR, "The image %s is bigger than the maximum of %zu bytes",
+                 job->entry->url, loader.max_download_size);
         return 0;
     }
 
-    image_chunk->data = ptr;
+    // one more byte for the null terminator
+    if(needed + 1 > job->chunk_capacity) {
+        size_t capacity = job->chunk_capacity * 2;
+
+        // the first time we know the size of the whole body if the server sent it
+        curl_off_t content_length = -1;
+        if(job->chunk_capacity == 0) {
+            curl_easy_getinfo(job->curl_handle, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &content_length);
+            capacity = content_length > 0 ? (size_t)content_length : DOWNLOAD_BUFFER_INITIAL_SIZE;
+        }
+
+        if(capacity < needed) capacity = needed;
+        if(capacity > loader.max_download_size) capacity = loader.max_download_size;
+        capacity++;
+
+        char *ptr = realloc(image_chunk->data, capacity);
+        if(!ptr) {
+            TraceLog(LOG_ERROR, "Error trying to reallocate memory for the image chunk");
+            return 0;
+        }
+
+        image_chunk->data = ptr;
+        job->chunk_capacity = capacity;
+        loader.buffer_reallocs++;
+    }
+
+    loader.downloaded_bytes += real_size;
     memcpy(&(image_chunk->data[image_chunk->size]), contents, real_size);
     image_chunk->size += real_size;
     image_chunk->data[image_chunk->size] = 0;
 
+    if(!job->probed && image_chunk->size <= PROBE_MAX_BYTES) {
+        int width, height;
+        if(probe_image_size(image_chunk->data, image_chunk->size, &width, &height)) {
+            job->probed = true;
+            set_image_size(job->entry, width, height);
+        }
+    }
+
     return real_size;
 }
 
+static int progress_callback(void *arg, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow)
+{
+    (void)dltotal; (void)dlnow; (void)ultotal; (void)ulnow;
+    DecodeJob *job = (DecodeJob *)arg;
+
+    // an image far away from the viewport shouldn't use a connection that a
+    // closer one is waiting for
+    int priority = atomic_load_explicit(&job->entry->priority, memory_order_relaxed);
+    if(priority > CANCEL_MIN_DISTANCE && priority > loader.best_waiting_priority) {
+        job->cancelled = true;
+        return 1;
+    }
+
+    return 0;
+}
+
+static size_t header_callback(char *buffer, size_t size, size_t nitems, void *meta)
+{
+    cache_metadata_parse_header((CacheMetadata *)meta, buffer, size * nitems);
+    return size * nitems;
+}
+
 // dest should allocate enough data for 4 chars and one for null char
 // NOTE: if the extension is not found or the extension is bigger than 4 chars
 // we do nothing to the dest string
@@ -47,107 +414,1558 @@ void get_image_ext(char *dest, const char *path)
     strcpy(dest, path + dot_pos);
 }
 
-void *load_image_from_url(void *arg)
+// delays is only used by animated images, the entry takes its ownership
+static void finish_image_load(ImageEntry *entry, DecodedImage *decoded, int *delays)
 {
-    ImageNode *image_node = (ImageNode *)arg;
+    bool upgrading = atomic_load(&entry->upgrading);
 
-    CURL *curl_handle;
-    CURLcode res;
+    if(IsImageValid(decoded->image)) {
+        entry->image = decoded->image;
+        entry->image_mapping_size = decoded->mapping_size;
+        entry->image_frames_count = decoded->frames_count;
+        entry->image_delays = delays;
+        set_image_size(entry, decoded->width, decoded->height);
+        // the release makes the image visible to the render thread before the state
+        atomic_store_explicit(&entry->state, IMAGE_DECODED, memory_order_release);
+    } else if(upgrading) {
+        // we keep showing the lower resolution texture
+        atomic_store(&entry->state, IMAGE_UPLOADED);
+    } else {
+        atomic_store(&entry->state, IMAGE_FAILED);
+    }
+    atomic_store(&entry->upgrading, false);
 
-    ImageChunk chunk = {
-        .data = malloc(1),
-        .size = 0,
-    };
+    if(!IsImageValid(decoded->image)) free(delays);
 
-    curl_global_init(CURL_GLOBAL_ALL);
-    curl_handle = curl_easy_init();
+    // failed loads are sent too, the render thread needs to know when the
+    // loader is done with the entry before freeing it
+    mpsc_queue_push(&loader.completed, &entry->completed_link);
 
-    pthread_mutex_lock(&mutex_lock);
-    curl_easy_setopt(curl_handle, CURLOPT_URL, image_node->url);
-    pthread_mutex_unlock(&mutex_lock);
+    if(atomic_fetch_sub(&loader.in_flight, 1) == 1) {
+        TraceLog(LOG_INFO, "IMAGE: Loaded %zu images in %.2f ms",
+                 atomic_exchange(&loader.batch_count, 0), get_time_ms() - loader.batch_start);
+    }
+}
 
-    curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, write_memory_callback);
-    curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void *)&chunk);
-    curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, "libcurl-agent/1.0");
+// maps the file of a local image, so it's decoded without copying its bytes
+static bool map_image_file(ImageEntry *entry, ImageChunk *chunk)
+{
+    int fd = open(entry->path, O_RDONLY);
+    if(fd == -1) {
+        TraceLog(LOG_ERROR, "Couldn't open image %s", entry->path);
+        return false;
+    }
 
-    res = curl_easy_perform(curl_handle);
+    struct stat st;
+    if(fstat(fd, &st) == -1 || st.st_size == 0) {
+        TraceLog(LOG_ERROR, "The given path %s is not a valid image", entry->path);
+        close(fd);
+        return false;
+    }
 
-    if(res != CURLE_OK) {
-        TraceLog(LOG_ERROR, "curl_easy_perform() failed: %s", curl_easy_strerror(res));
-        return NULL;
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if(data == MAP_FAILED) {
+        TraceLog(LOG_ERROR, "Couldn't map image %s", entry->path);
+        return false;
+    }
+
+    chunk->data = data;
+    chunk->size = st.st_size;
+
+    int width, height;
+    if(entry->width == 0 && probe_image_size(chunk->data, chunk->size, &width, &height)) {
+        set_image_size(entry, width, height);
+    }
+
+    return true;
+}
+
+static bool is_data_url(const char *url)
+{
+    return strncmp(url, "data:", 5) == 0;
+}
+
+// decodes the base64 payload of a data url like data:image/png;base64,...
+// and sets the extension of the image from its media type
+static bool decode_data_url(ImageEntry *entry, ImageChunk *chunk, char *ext)
+{
+    const char *media_type = entry->url + 5;
+    const char *data = strchr(media_type, ',');
+
+    if(data == NULL || data - media_type < 7 || strncmp(data - 7, ";base64", 7) != 0) {
+        TraceLog(LOG_ERROR, "Only base64 data urls are supported for images");
+        return false;
+    }
+
+    // the media type is something like image/png, the extension is its subtype
+    const char *subtype = memchr(media_type, '/', data - media_type);
+    if(subtype != NULL) {
+        size_t subtype_size = strcspn(subtype + 1, ";,");
+
+        if(subtype_size == 4 && strncmp(subtype + 1, "jpeg", 4) == 0) {
+            strcpy(ext, ".jpg");
+        } else if(subtype_size <= 3) {
+            snprintf(ext, 5, ".%.*s", (int)subtype_size, subtype + 1);
+        }
+    }
+
+    data++;
+    size_t size = strlen(data);
+    unsigned char *bytes = malloc(base64_decoded_size(size));
+    long decoded = bytes != NULL ? base64_decode(data, size, bytes) : -1;
+
+    if(decoded <= 0) {
+        TraceLog(LOG_ERROR, "The data url of the image is not valid base64");
+        free(bytes);
+        return false;
+    }
+
+    chunk->data = (char *)bytes;
+    chunk->size = decoded;
+
+    int width, height;
+    if(entry->width == 0 && probe_image_size(chunk->data, chunk->size, &width, &height)) {
+        set_image_size(entry, width, height);
     }
 
-    char image_ext[5] = ".jpg";
-    get_image_ext(image_ext, image_node->url);
+    return true;
+}
 
-    pthread_mutex_lock(&mutex_lock);
-    image_node->image = LoadImageFromMemory(image_ext, (unsigned char *)chunk.data, chunk.size);
-    image_node->loading_image = false;
+// stb may find a different number of frames than us in a damaged gif, so
+// the missing delays get the default one
+static int *get_frame_delays(ImageChunk chunk, int frames_count)
+{
+    int *delays = NULL;
+    int count = read_gif_delays(chunk.data, chunk.size, &delays);
+    if(count >= frames_count) return delays;
 
-    if(!IsImageValid(image_node->image)) {
-        TraceLog(LOG_ERROR, "The given url %s is not a valid image", image_node->url);
-        pthread_mutex_unlock(&mutex_lock);
+    int *items = realloc(delays, frames_count * sizeof(int));
+    if(items == NULL) {
+        free(delays);
         return NULL;
     }
-    pthread_mutex_unlock(&mutex_lock);
 
-    curl_easy_cleanup(curl_handle);
-    free(chunk.data);
-    curl_global_cleanup();
+    for(int i = count; i < frames_count; i++) items[i] = ANIMATION_DEFAULT_DELAY_MS;
+    return items;
+}
+
+// sends an image that isn't fresh in the disk cache back to the downloader
+static bool request_fetch(ImageEntry *entry, CacheMetadata *cached_meta)
+{
+    FetchRequest *fetch = malloc(sizeof(FetchRequest));
+
+    if(fetch == NULL) {
+        TraceLog(LOG_ERROR, "Couldn't allocate memory for the image transfer");
+        return false;
+    }
+
+    fetch->entry = entry;
+    fetch->revalidate = cached_meta != NULL;
+    if(cached_meta) fetch->cached_meta = *cached_meta;
+
+    pthread_mutex_lock(&loader.decode_lock);
+    da_append(&loader.fetches, fetch);
+    pthread_mutex_unlock(&loader.decode_lock);
+
+    curl_multi_wakeup(loader.multi);
+    return true;
+}
+
+enum CacheStepResult {
+    CACHE_STEP_READY,
+    // the image isn't in the cache, the downloader fetches it
+    CACHE_STEP_FETCH,
+    CACHE_STEP_FAILED,
+};
+
+static enum CacheStepResult run_cache_step(DecodeJob *job)
+{
+    const char *url = job->entry->url;
+
+    switch(job->cache) {
+    case CACHE_LOOKUP: {
+        CacheMetadata meta;
+        bool cached = image_cache_lookup(url, &meta);
+
+        if(cached && image_cache_is_fresh(&meta)) {
+            job->chunk.data = image_cache_read(url, &job->chunk.size);
+            if(job->chunk.data != NULL) break;
+
+            cached = false;
+        }
+
+        return request_fetch(job->entry, cached ? &meta : NULL) ? CACHE_STEP_FETCH : CACHE_STEP_FAILED;
+    }
+    case CACHE_STORE:
+        // without a disk copy we keep the bytes around to decode the image
+        // again after it gets evicted
+        job->keep_data = !image_cache_store(url, job->chunk.data, job->chunk.size, &job->meta);
+        if(job->keep_data) job->entry->source = job->chunk;
+        break;
+    case CACHE_REFRESH:
+        image_cache_update_metadata(url, &job->meta);
+        // fall through
+    case CACHE_READ:
+        job->chunk.data = image_cache_read(url, &job->chunk.size);
+
+        if(job->chunk.data == NULL) {
+            TraceLog(LOG_ERROR, "Couldn't read the cached copy of image %s", url);
+            return CACHE_STEP_FAILED;
+        }
+        break;
+    case CACHE_NONE:
+        break;
+    }
+
+    // images coming from the cache haven't been probed yet
+    int width, height;
+    if(job->entry->width == 0 && probe_image_size(job->chunk.data, job->chunk.size, &width, &height)) {
+        set_image_size(job->entry, width, height);
+    }
+
+    return CACHE_STEP_READY;
+}
+
+// arg is the decoder process of the thread, or NULL to decode in this process
+static void *decode_worker(void *arg)
+{
+    DecoderProcess *process = (DecoderProcess *)arg;
+    trace_set_thread_name("decoder");
+
+    pthread_mutex_lock(&loader.decode_lock);
+    while(true) {
+        while(loader.running && loader.decode.count == 0) {
+            pthread_cond_wait(&loader.decode_cond, &loader.decode_lock);
+        }
+
+        if(!loader.running) break;
+
+        // the closest image to the viewport is decoded first
+        size_t closest = 0;
+        for(size_t i = 1; i < loader.decode.count; i++) {
+            if(loader.decode.items[i].entry->priority < loader.decode.items[closest].entry->priority) {
+                closest = i;
+            }
+        }
+
+        DecodeJob job = loader.decode.items[closest];
+        loader.decode.items[closest] = loader.decode.items[--loader.decode.count];
+        pthread_mutex_unlock(&loader.decode_lock);
+
+        char image_ext[5] = ".jpg";
+
+        bool ok = true;
+        if(job.mapped) {
+            trace_begin_detail("fetch", job.entry->url);
+            ok = map_image_file(job.entry, &job.chunk);
+            get_image_ext(image_ext, job.entry->path);
+            trace_end();
+        } else if(job.embedded) {
+            trace_begin("fetch");
+            ok = decode_data_url(job.entry, &job.chunk, image_ext);
+            trace_end();
+        } else {
+            get_image_ext(image_ext, job.entry->url);
+
+            if(job.cache != CACHE_NONE) {
+                trace_begin_detail("cache", job.entry->url);
+                enum CacheStepResult result = run_cache_step(&job);
+                trace_end();
+
+                if(result == CACHE_STEP_FETCH) {
+                    pthread_mutex_lock(&loader.decode_lock);
+                    continue;
+                }
+                ok = result == CACHE_STEP_READY;
+            }
+        }
+
+        if(!ok) {
+            finish_image_load(job.entry, &(DecodedImage){0}, NULL);
+            pthread_mutex_lock(&loader.decode_lock);
+            continue;
+        }
+
+        double decode_start = get_time_ms();
+        trace_begin_detail("decode", job.entry->url);
+
+        DecodedImage decoded = {0};
+        if(process != NULL) {
+            decoder_process_decode(process, image_ext, job.chunk.data, job.chunk.size,
+                                   loader.target_width, loader.mipmaps, &decoded);
+        } else {
+            decoded = decode_image(image_ext, job.chunk.data, job.chunk.size,
+                                   loader.target_width, loader.mipmaps);
+        }
+
+        int *delays = NULL;
+        if(decoded.frames_count > 1) delays = get_frame_delays(job.chunk, decoded.frames_count);
+        trace_end();
+
+        if(job.mapped) {
+            munmap(job.chunk.data, job.chunk.size);
+        } else if(!job.keep_data) {
+            free(job.chunk.data);
+        }
+
+        if(!IsImageValid(decoded.image)) {
+            TraceLog(LOG_ERROR, "The given url %.*s is not a valid image", LOG_URL_MAX, job.entry->url);
+        } else {
+            telemetry_record(TELEMETRY_DECODE, (get_time_ms() - decode_start) * 1000);
+        }
+
+        finish_image_load(job.entry, &decoded, delays);
+
+        pthread_mutex_lock(&loader.decode_lock);
+    }
+    pthread_mutex_unlock(&loader.decode_lock);
 
     return NULL;
 }
 
-void image_loader_init(ImageNode *node)
+static void push_decode_job(DecodeJob job)
 {
-    pthread_mutex_init(&mutex_lock, NULL);
+    pthread_mutex_lock(&loader.decode_lock);
+    da_append(&loader.decode, job);
+    pthread_cond_signal(&loader.decode_cond);
+    pthread_mutex_unlock(&loader.decode_lock);
 }
 
-Vector2 draw_image_node(Vector2 pos, int screen_width, ImageNode *node)
+
+// local and inline images skip the downloader, the decoder reads them directly
+static void queue_direct_decode(ImageEntry *entry)
 {
-    pthread_mutex_lock(&mutex_lock);
-    if(node->loading_image) {
-        pthread_mutex_unlock(&mutex_lock);
-        return Vector2Zero();
+    DecodeJob job = {
+        .entry = entry,
+        .mapped = entry->path != NULL,
+        .embedded = entry->path == NULL,
+    };
+    push_decode_job(job);
+}
+
+static bool load_request_less(LoadRequest *a, LoadRequest *b)
+{
+    if(a->priority != b->priority) return a->priority < b->priority;
+    return a->order < b->order;
+}
+
+static void load_queue_sift_down(LoadQueue *queue, size_t i)
+{
+    while(true) {
+        size_t smallest = i;
+        size_t left = i * 2 + 1;
+        size_t right = i * 2 + 2;
+
+        if(left < queue->count && load_request_less(&queue->items[left], &queue->items[smallest])) smallest = left;
+        if(right < queue->count && load_request_less(&queue->items[right], &queue->items[smallest])) smallest = right;
+        if(smallest == i) return;
+
+        LoadRequest tmp = queue->items[i];
+        queue->items[i] = queue->items[smallest];
+        queue->items[smallest] = tmp;
+        i = smallest;
+    }
+}
+
+static void load_queue_push(LoadQueue *queue, ImageEntry *entry, FetchRequest *fetch)
+{
+    LoadRequest request = {
+        .entry = entry,
+        .priority = atomic_load_explicit(&entry->priority, memory_order_relaxed),
+        .order = entry->load_order,
+        .fetch = fetch,
+    };
+    da_append(queue, request);
+
+    size_t i = queue->count - 1;
+    while(i > 0) {
+        size_t parent = (i - 1) / 2;
+        if(!load_request_less(&queue->items[i], &queue->items[parent])) break;
+
+        LoadRequest tmp = queue->items[i];
+        queue->items[i] = queue->items[parent];
+        queue->items[parent] = tmp;
+        i = parent;
+    }
+}
+
+static LoadRequest load_queue_pop(LoadQueue *queue)
+{
+    LoadRequest request = queue->items[0];
+    queue->items[0] = queue->items[--queue->count];
+    load_queue_sift_down(queue, 0);
+
+    return request;
+}
+
+// the priorities change as the user scrolls, so we take them again and rebuild the heap
+static void load_queue_reprioritize(LoadQueue *queue)
+{
+    for(size_t i = 0; i < queue->count; i++) {
+        queue->items[i].priority = atomic_load_explicit(&queue->items[i].entry->priority, memory_order_relaxed);
+    }
+
+    for(size_t i = queue->count / 2; i-- > 0;) {
+        load_queue_sift_down(queue, i);
+    }
+}
+
+static void add_transfer(ImageEntry *entry, CacheMetadata *cached_meta)
+{
+    DecodeJob *job = calloc(1, sizeof(DecodeJob));
+
+    if(job == NULL) {
+        TraceLog(LOG_ERROR, "Couldn't allocate memory for the image transfer");
+        return;
+    }
+
+    CURL *curl_handle = curl_easy_init();
+    job->entry = entry;
+    job->curl_handle = curl_handle;
+    cache_metadata_reset(&job->meta);
+
+    if(cached_meta) {
+        char header[512];
+        job->revalidating = true;
+        job->cached_meta = *cached_meta;
+
+        if(cached_meta->etag[0]) {
+            snprintf(header, sizeof(header), "If-None-Match: %s", cached_meta->etag);
+            job->headers = curl_slist_append(job->headers, header);
+        }
+        if(cached_meta->last_modified[0]) {
+            snprintf(header, sizeof(header), "If-Modified-Since: %s", cached_meta->last_modified);
+            job->headers = curl_slist_append(job->headers, header);
+        }
+
+        curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, job->headers);
+        curl_easy_setopt(curl_handle, CURLOPT_CONNECTTIMEOUT_MS, (long)REVALIDATION_CONNECT_TIMEOUT_MS);
+    }
+
+    curl_easy_setopt(curl_handle, CURLOPT_URL, entry->url);
+    // the urls that aren't local files still reach here, like file://host/a.png,
+    // curl mustn't read them nor use any other protocol
+    curl_easy_setopt(curl_handle, CURLOPT_PROTOCOLS_STR, "http,https");
+    // rejects the images with a bigger Content-Length before downloading them
+    curl_easy_setopt(curl_handle, CURLOPT_MAXFILESIZE_LARGE, (curl_off_t)loader.max_download_size);
+    curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, write_memory_callback);
+    curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void *)job);
+    curl_easy_setopt(curl_handle, CURLOPT_HEADERFUNCTION, header_callback);
+    curl_easy_setopt(curl_handle, CURLOPT_HEADERDATA, (void *)&job->meta);
+    curl_easy_setopt(curl_handle, CURLOPT_PRIVATE, (void *)job);
+    curl_easy_setopt(curl_handle, CURLOPT_XFERINFOFUNCTION, progress_callback);
+    curl_easy_setopt(curl_handle, CURLOPT_XFERINFODATA, (void *)job);
+    curl_easy_setopt(curl_handle, CURLOPT_NOPROGRESS, 0L);
+    curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, "libcurl-agent/1.0");
+    curl_easy_setopt(curl_handle, CURLOPT_TCP_KEEPALIVE, 1L);
+    // prefer waiting for a connection that can be multiplexed over opening a new one
+    curl_easy_setopt(curl_handle, CURLOPT_PIPEWAIT, 1L);
+    curl_easy_setopt(curl_handle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+
+    curl_multi_add_handle(loader.multi, curl_handle);
+    da_append(&loader.transfers, job);
+    trace_begin_async("fetch", (uintptr_t)job, entry->url);
+}
+
+static void remove_transfer(DecodeJob *job)
+{
+    trace_end_async("fetch", (uintptr_t)job);
+
+    for(size_t i = 0; i < loader.transfers.count; i++) {
+        if(loader.transfers.items[i] != job) continue;
+        loader.transfers.items[i] = loader.transfers.items[--loader.transfers.count];
+        break;
+    }
+
+    curl_multi_remove_handle(loader.multi, job->curl_handle);
+    curl_easy_cleanup(job->curl_handle);
+    curl_slist_free_all(job->headers);
+}
+
+// splits the cumulative times of curl into the steps of the transfer
+// the phases a failed transfer didn't reach are reported as 0, or -1, so
+// the differences between them can be negative
+static void record_transfer_time(enum TelemetryMetric metric, curl_off_t value)
+{
+    if(value < 0) return;
+    telemetry_record(metric, value);
+}
+
+static void record_transfer_telemetry(CURL *curl_handle)
+{
+    curl_off_t dns = 0, connect = 0, tls = 0, start = 0, total = 0, bytes = 0, connects = 0;
+    curl_easy_getinfo(curl_handle, CURLINFO_NAMELOOKUP_TIME_T, &dns);
+    curl_easy_getinfo(curl_handle, CURLINFO_CONNECT_TIME_T, &connect);
+    curl_easy_getinfo(curl_handle, CURLINFO_APPCONNECT_TIME_T, &tls);
+    curl_easy_getinfo(curl_handle, CURLINFO_STARTTRANSFER_TIME_T, &start);
+    curl_easy_getinfo(curl_handle, CURLINFO_TOTAL_TIME_T, &total);
+    curl_easy_getinfo(curl_handle, CURLINFO_SIZE_DOWNLOAD_T, &bytes);
+    curl_easy_getinfo(curl_handle, CURLINFO_NUM_CONNECTS, &connects);
+
+    // reused connections don't resolve nor connect
+    if(connects > 0) {
+        record_transfer_time(TELEMETRY_DNS, dns);
+        if(connect > 0) record_transfer_time(TELEMETRY_CONNECT, connect - dns);
+        if(tls > 0) record_transfer_time(TELEMETRY_TLS, tls - connect);
+    }
+
+    // without a response there's no wait nor transfer
+    if(start > 0) {
+        curl_off_t ready = tls > connect ? tls : connect;
+        record_transfer_time(TELEMETRY_WAIT, start - ready);
+        record_transfer_time(TELEMETRY_TRANSFER, total - start);
+    }
+    record_transfer_time(TELEMETRY_FETCH, total);
+    record_transfer_time(TELEMETRY_BYTES, bytes);
+}
+
+static void finish_transfer(CURL *curl_handle, CURLcode res)
+{
+    DecodeJob *job;
+    curl_easy_getinfo(curl_handle, CURLINFO_PRIVATE, (char **)&job);
+
+    long status = 0;
+    curl_easy_getinfo(curl_handle, CURLINFO_RESPONSE_CODE, &status);
+    remove_transfer(job);
+
+    if(res == CURLE_ABORTED_BY_CALLBACK && job->cancelled) {
+        // it goes back to wait for its turn, the download starts from scratch
+        // but the disk cache was already checked
+        int fetching = IMAGE_FETCHING;
+        atomic_compare_exchange_strong(&job->entry->state, &fetching, IMAGE_QUEUED);
+
+        FetchRequest *fetch = malloc(sizeof(FetchRequest));
+        if(fetch != NULL) {
+            fetch->entry = job->entry;
+            fetch->revalidate = job->revalidating;
+            fetch->cached_meta = job->cached_meta;
+        }
+        load_queue_push(&loader.waiting, job->entry, fetch);
+
+        free(job->chunk.data);
+        free(job);
+        return;
     }
-    pthread_mutex_unlock(&mutex_lock);
 
-    if(!node->texture_loaded) {
-        node->texture_loaded = true;
-        node->texture = LoadTextureFromImage(node->image);
+    const char *url = job->entry->url;
+    cache_metadata_finish(&job->meta);
+
+    bool ok = res == CURLE_OK;
+    enum CacheStep cache = CACHE_NONE;
+    if(ok) record_transfer_telemetry(curl_handle);
+
+    // the body of an error response is an error page, not the image, the
+    // protocols other than http don't have a status
+    bool success_status = status == 0 || (status >= 200 && status < 300);
+
+    if(ok && status == 304 && job->revalidating) {
+        // a 304 may not repeat the validators, so we keep the cached ones
+        if(!job->meta.etag[0]) strcpy(job->meta.etag, job->cached_meta.etag);
+        if(!job->meta.last_modified[0]) strcpy(job->meta.last_modified, job->cached_meta.last_modified);
+
+        cache = CACHE_REFRESH;
+    } else if(ok && success_status) {
+        cache = CACHE_STORE;
+    } else if(job->revalidating) {
+        // the server is unreachable or failed, a stale image is better than no image
+        TraceLog(LOG_WARNING, "Couldn't revalidate image %s, using the cached one", url);
+        cache = CACHE_READ;
     }
 
-    Vector2 image_size = {0};
+    if(cache != CACHE_NONE) {
+        // the body of a 304 or of a failed response isn't the image, the
+        // decoder reads the cached one
+        if(cache != CACHE_STORE) {
+            free(job->chunk.data);
+            job->chunk = (ImageChunk){0};
+        }
 
-    if(node->texture.width > screen_width) {
-        float scale = screen_width / (float)node->texture.width;
-        DrawTextureEx(node->texture, pos, 0, scale, WHITE);
-        image_size.x = screen_width;
-        image_size.y = node->texture.height * scale;
+        DecodeJob decode_job = {
+            .entry = job->entry,
+            .chunk = job->chunk,
+            .meta = job->meta,
+            .cache = cache,
+        };
+        push_decode_job(decode_job);
     } else {
-        DrawTexture(node->texture, pos.x, pos.y, WHITE);
-        image_size.x = node->texture.width;
-        image_size.y = node->texture.height;
+        if(res == CURLE_OK) {
+            TraceLog(LOG_ERROR, "Couldn't download image %s: HTTP status %ld", url, status);
+        } else {
+            TraceLog(LOG_ERROR, "Couldn't download image %s: %s", url, curl_easy_strerror(res));
+        }
+        free(job->chunk.data);
+        finish_image_load(job->entry, &(DecodedImage){0}, NULL);
     }
 
-    return image_size;
+    free(job);
+}
+
+static void start_image_load(LoadRequest request)
+{
+    ImageEntry *entry = request.entry;
+
+    // images being upgraded stay in the uploaded state
+    int queued = IMAGE_QUEUED;
+    atomic_compare_exchange_strong(&entry->state, &queued, IMAGE_FETCHING);
+
+    if(entry->path != NULL || is_data_url(entry->url)) {
+        queue_direct_decode(entry);
+        return;
+    }
+
+    if(request.fetch != NULL) {
+        add_transfer(entry, request.fetch->revalidate ? &request.fetch->cached_meta : NULL);
+        free(request.fetch);
+        return;
+    }
+
+    DecodeJob job = {
+        .entry = entry,
+        .chunk = entry->source,
+        .keep_data = entry->source.data != NULL,
+        // the decoder looks into the disk cache and sends the image back here
+        // when it has to be fetched
+        .cache = entry->source.data != NULL ? CACHE_NONE : CACHE_LOOKUP,
+    };
+    push_decode_job(job);
 }
 
-void image_loader_async_load(ImageNode *node)
+// picks up the images the decoders didn't find in the disk cache
+static void take_fetch_requests()
 {
-    pthread_t tid;
-    pthread_create(&tid, NULL, &load_image_from_url, node);
+    pthread_mutex_lock(&loader.decode_lock);
+    for(size_t i = 0; i < loader.fetches.count; i++) {
+        FetchRequest *fetch = loader.fetches.items[i];
+        load_queue_push(&loader.waiting, fetch->entry, fetch);
+    }
+    loader.fetches.count = 0;
+    pthread_mutex_unlock(&loader.decode_lock);
 }
 
-void free_image_node(ImageNode *node)
+static void *downloader_worker(void *arg)
 {
-    free(node->alt);
-    free(node->url);
-    UnloadTexture(node->texture);
-    UnloadImage(node->image);
+    (void)arg;
+    trace_set_thread_name("downloader");
+
+    unsigned int generation = 0;
+
+    while(loader.running) {
+        MPSCNode *link;
+        while((link = mpsc_queue_pop(&loader.pending))) {
+            load_queue_push(&loader.waiting, mpsc_container_of(link, ImageEntry, pending_link), NULL);
+        }
+        take_fetch_requests();
+
+        unsigned int new_generation = atomic_load(&loader.priorities_generation);
+        if(new_generation != generation) {
+            generation = new_generation;
+            load_queue_reprioritize(&loader.waiting);
+        }
+
+        // the images are first looked up in the disk cache by the decoders,
+        // only the ones coming back from them take a transfer
+        while(loader.waiting.count > 0 && loader.transfers.count < MAX_ACTIVE_TRANSFERS) {
+            start_image_load(load_queue_pop(&loader.waiting));
+        }
+
+        loader.best_waiting_priority = loader.waiting.count > 0 ? loader.waiting.items[0].priority : INT_MAX;
+
+        int still_running;
+        curl_multi_perform(loader.multi, &still_running);
+
+        CURLMsg *msg;
+        int msgs_left;
+        while((msg = curl_multi_info_read(loader.multi, &msgs_left))) {
+            if(msg->msg == CURLMSG_DONE) {
+                finish_transfer(msg->easy_handle, msg->data.result);
+            }
+        }
+
+        curl_multi_poll(loader.multi, NULL, 0, DOWNLOADER_POLL_TIMEOUT_MS, NULL);
+    }
+
+    // abort the transfers that are still in flight
+    while(loader.transfers.count > 0) {
+        DecodeJob *job = loader.transfers.items[0];
+        remove_transfer(job);
+        free(job->chunk.data);
+        free(job);
+    }
+    da_free(&loader.transfers);
+    for(size_t i = 0; i < loader.waiting.count; i++) free(loader.waiting.items[i].fetch);
+    da_free(&loader.waiting);
+
+    return NULL;
 }
 
-void image_loader_destroy()
+void image_loader_init(const char *document_path)
 {
-    pthread_mutex_destroy(&mutex_lock);
+    char *document_dir = strdup(document_path);
+    loader.base_dir = strdup(dirname(document_dir));
+    free(document_dir);
+
+    pthread_mutex_init(&loader.decode_lock, NULL);
+    pthread_cond_init(&loader.decode_cond, NULL);
+    mpsc_queue_init(&loader.pending);
+    mpsc_queue_init(&loader.completed);
+
+    curl_global_init(CURL_GLOBAL_ALL);
+    image_cache_init();
+
+    loader.multi = curl_multi_init();
+    curl_multi_setopt(loader.multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+    curl_multi_setopt(loader.multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)MAX_HOST_CONNECTIONS);
+    curl_multi_setopt(loader.multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, (long)MAX_TOTAL_CONNECTIONS);
+
+    loader.target_width = GetScreenWidth();
+    loader.running = true;
+    pthread_create(&loader.downloader, NULL, &downloader_worker, NULL);
+
+    textures.budget = IMAGE_MEMORY_BUDGET;
+    const char *budget = getenv("MD_RAYDER_IMAGE_MEMORY_MB");
+    if(budget != NULL && atol(budget) > 0) {
+        textures.budget = atol(budget) * 1024 * 1024;
+    }
+
+    loader.max_download_size = IMAGE_MAX_DOWNLOAD_SIZE;
+    const char *max_size = getenv("MD_RAYDER_IMAGE_MAX_MB");
+    if(max_size != NULL && atol(max_size) > 0) {
+        loader.max_download_size = atol(max_size) * 1024 * 1024;
+    }
+
+    const char *isolated = getenv("MD_RAYDER_ISOLATE_DECODERS");
+    loader.isolated = isolated != NULL && atoi(isolated) > 0;
+
+    const char *mipmaps = getenv("MD_RAYDER_IMAGE_MIPMAPS");
+    loader.mipmaps = mipmaps != NULL && atoi(mipmaps) > 0;
+
+    long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+    loader.decoders_count = Clamp(cpu_count, 1, MAX_DECODE_WORKERS);
+    for(size_t i = 0; i < loader.decoders_count; i++) {
+        DecoderProcess *process = NULL;
+
+        // the threads whose process can't be started decode in this process
+        if(loader.isolated && decoder_process_start(&loader.processes[i])) {
+            process = &loader.processes[i];
+        }
+
+        pthread_create(&loader.decoders[i], NULL, &decode_worker, process);
+    }
+}
+
+static void queue_image_load(ImageEntry *entry)
+{
+    entry->loading = true;
+    entry->requested_at = get_time_ms();
+    entry->load_order = atomic_fetch_add(&loader.requests_count, 1);
+
+    if(atomic_fetch_add(&loader.in_flight, 1) == 0) {
+        loader.batch_start = get_time_ms();
+    }
+    atomic_fetch_add(&loader.batch_count, 1);
+
+    mpsc_queue_push(&loader.pending, &entry->pending_link);
+    curl_multi_wakeup(loader.multi);
+}
+
+static void image_loader_async_load(ImageEntry *entry)
+{
+    atomic_store(&entry->state, IMAGE_QUEUED);
+    queue_image_load(entry);
+}
+
+static size_t get_pixels_memory(int width, int height, int format, int mipmaps)
+{
+    size_t size = 0;
+
+    for(int i = 0; i < mipmaps; i++) {
+        size += GetPixelDataSize(width, height, format);
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+
+    return size;
+}
+
+static size_t get_image_memory(Image image, int frames_count)
+{
+    size_t size = get_pixels_memory(image.width, image.height, image.format, image.mipmaps);
+    return frames_count > 1 ? size * frames_count : size;
+}
+
+static size_t get_node_memory(ImageEntry *entry)
+{
+    Texture2D tex = entry->texture;
+
+    return get_pixels_memory(tex.width, tex.height, tex.format, tex.mipmaps)
+           + get_image_memory(entry->image, entry->image_frames_count)
+           + get_image_memory(entry->animation.frames, entry->animation.frames_count);
+}
+
+static void untrack_resident_image(ImageEntry *entry)
+{
+    if(!entry->resident) return;
+
+    for(size_t i = 0; i < textures.resident.count; i++) {
+        if(textures.resident.items[i] != entry) continue;
+        textures.resident.items[i] = textures.resident.items[--textures.resident.count];
+        break;
+    }
+
+    textures.used -= entry->memory_size;
+    entry->resident = false;
+}
+
+static void unload_pixels(Image image, size_t mapping_size)
+{
+    if(mapping_size > 0) {
+        decoder_process_unload_image(image, mapping_size);
+    } else {
+        UnloadImage(image);
+    }
+}
+
+static void unload_entry_image(ImageEntry *entry)
+{
+    unload_pixels(entry->image, entry->image_mapping_size);
+    free(entry->image_delays);
+
+    entry->image = (Image){0};
+    entry->image_mapping_size = 0;
+    entry->image_frames_count = 0;
+    entry->image_delays = NULL;
+}
+
+static void stop_animation(ImageEntry *entry)
+{
+    ImageAnimation *animation = &entry->animation;
+    if(animation->frames_count == 0) return;
+
+    for(size_t i = 0; i < textures.animations.count; i++) {
+        if(textures.animations.items[i] != entry) continue;
+        textures.animations.items[i] = textures.animations.items[--textures.animations.count];
+        break;
+    }
+
+    unload_pixels(animation->frames, animation->mapping_size);
+    free(animation->delays);
+    *animation = (ImageAnimation){0};
+}
+
+// the decoded frames are kept to update the texture with them
+static void start_animation(ImageEntry *entry)
+{
+    stop_animation(entry);
+
+    entry->animation = (ImageAnimation){
+        .frames = entry->image,
+        .mapping_size = entry->image_mapping_size,
+        .frames_count = entry->image_frames_count,
+        .delays = entry->image_delays,
+        .paused = true,
+    };
+    da_append(&textures.animations, entry);
+
+    entry->image = (Image){0};
+    entry->image_mapping_size = 0;
+    entry->image_frames_count = 0;
+    entry->image_delays = NULL;
+}
+
+static int get_frame_delay(ImageAnimation *animation, int frame)
+{
+    return animation->delays != NULL ? animation->delays[frame] : ANIMATION_DEFAULT_DELAY_MS;
+}
+
+// only the animations that were on the screen in the last frame advance, the
+// rest stay paused and don't cost anything
+static void advance_animations()
+{
+    double now = get_time_ms();
+
+    for(size_t i = 0; i < textures.animations.count; i++) {
+        ImageEntry *entry = textures.animations.items[i];
+        ImageAnimation *animation = &entry->animation;
+
+        bool on_screen = entry->last_visible_frame == textures.frame && entry->on_screen;
+        if(!on_screen) {
+            animation->paused = true;
+            continue;
+        }
+
+        // it continues from the frame where it was paused
+        if(animation->paused) {
+            animation->paused = false;
+            animation->next_frame_time = now + get_frame_delay(animation, animation->current_frame);
+            continue;
+        }
+
+        if(now < animation->next_frame_time) continue;
+
+        // the frames that should have been shown while we were busy are skipped
+        while(now >= animation->next_frame_time) {
+            animation->current_frame = (animation->current_frame + 1) % animation->frames_count;
+            animation->next_frame_time += get_frame_delay(animation, animation->current_frame);
+        }
+
+        Image frames = animation->frames;
+        size_t frame_size = GetPixelDataSize(frames.width, frames.height, frames.format);
+        UpdateTexture(entry->texture, (unsigned char *)frames.data + frame_size * animation->current_frame);
+    }
+}
+
+// drops the texture of an image that stopped waiting for its upload
+static void cancel_partial_upload(ImageEntry *entry)
+{
+    if(textures.uploading != entry) return;
+
+    if(textures.partial_texture.id != 0) UnloadTexture(textures.partial_texture);
+    textures.partial_texture = (Texture2D){0};
+    textures.uploading = NULL;
+}
+
+// entries the loader is working on can't be evicted, an upgrade could
+// publish its image right after we unload the old one, returns whether the
+// entry was evicted
+static bool evict_image(ImageEntry *entry)
+{
+    int state = atomic_load(&entry->state);
+    if(state != IMAGE_DECODED && state != IMAGE_UPLOADED) return false;
+    if(!atomic_compare_exchange_strong(&entry->state, &state, IMAGE_EVICTED)) return false;
+
+    untrack_resident_image(entry);
+
+    if(entry->texture.id != 0) UnloadTexture(entry->texture);
+    entry->texture = (Texture2D){0};
+
+    if(state == IMAGE_DECODED) {
+        cancel_partial_upload(entry);
+        unload_entry_image(entry);
+    }
+    stop_animation(entry);
+    return true;
+}
+
+// evicts the least recently visible images until there's space for the given
+// amount of bytes, images visible in the current frame and the ones still
+// being loaded are never evicted
+static void make_room_for(size_t size)
+{
+    while(textures.used + size > textures.budget) {
+        ImageEntry *lru = NULL;
+
+        for(size_t i = 0; i < textures.resident.count; i++) {
+            ImageEntry *entry = textures.resident.items[i];
+            if(entry->last_visible_frame == textures.frame || entry->loading) continue;
+
+            if(lru == NULL || entry->last_visible_frame < lru->last_visible_frame) {
+                lru = entry;
+            }
+        }
+
+        if(lru == NULL || !evict_image(lru)) break;
+    }
+}
+
+// an image is near the viewport when it's less than a screen away from it
+static bool is_near_viewport(Vector2 pos, Vector2 size)
+{
+    int screen_height = GetScreenHeight();
+    return pos.y + size.y >= -screen_height && pos.y <= screen_height * 2;
+}
+
+// should be called every time the texture or the decoded image of the entry change
+static void update_resident_memory(ImageEntry *entry)
+{
+    size_t size = get_node_memory(entry);
+    if(entry->resident && entry->memory_size == size) return;
+
+    untrack_resident_image(entry);
+    if(size == 0) return;
+
+    make_room_for(size);
+
+    entry->resident = true;
+    entry->memory_size = size;
+    textures.used += size;
+    da_append(&textures.resident, entry);
+}
+
+// uploads the next band of rows of the image, returns true once the whole
+// texture is uploaded
+static bool upload_texture_rows(ImageEntry *entry)
+{
+    Image *image = &entry->image;
+    double start = get_time_ms();
+    trace_begin_detail("upload", entry->url);
+
+    if(image->mipmaps > 1) {
+        // only the first level can be updated, so the images with mipmaps
+        // are uploaded at once
+        textures.uploading = entry;
+        textures.partial_texture = LoadTextureFromImage(*image);
+        textures.uploaded_rows = image->height;
+    } else if(textures.uploading != entry) {
+        // allocating the storage takes about as long as uploading a band, so
+        // it's a step of its own
+        textures.uploading = entry;
+        textures.uploaded_rows = 0;
+        textures.partial_texture = (Texture2D){
+            .id = rlLoadTexture(NULL, image->width, image->height, image->format, 1),
+            .width = image->width,
+            .height = image->height,
+            .mipmaps = 1,
+            .format = image->format,
+        };
+    } else {
+        // the first frame of an animation is at the start of its pixels
+        int row_size = GetPixelDataSize(image->width, 1, image->format);
+        int rows = Clamp(UPLOAD_STEP_BYTES / row_size, 1, image->height - textures.uploaded_rows);
+
+        if(textures.partial_texture.id != 0) {
+            rlUpdateTexture(textures.partial_texture.id, 0, textures.uploaded_rows, image->width, rows,
+                            image->format, (unsigned char *)image->data + (size_t)textures.uploaded_rows * row_size);
+        }
+        textures.uploaded_rows += rows;
+    }
+
+    trace_end();
+    double elapsed = get_time_ms() - start;
+    textures.upload_step_ms += (elapsed - textures.upload_step_ms) * 0.1;
+    telemetry_record(TELEMETRY_UPLOAD, elapsed * 1000);
+
+    return textures.uploaded_rows == image->height;
+}
+
+static void finish_texture_upload(ImageEntry *entry)
+{
+    // the new image replaces the lower resolution one
+    if(entry->texture.id != 0) UnloadTexture(entry->texture);
+
+    entry->texture = textures.partial_texture;
+    textures.partial_texture = (Texture2D){0};
+    textures.uploading = NULL;
+
+    if(entry->texture.mipmaps > 1) {
+        SetTextureFilter(entry->texture, TEXTURE_FILTER_TRILINEAR);
+    }
+
+    telemetry_record(TELEMETRY_LOAD, (get_time_ms() - entry->requested_at) * 1000);
+
+    // the texture shows the first frame
+    if(entry->image_frames_count > 1) {
+        start_animation(entry);
+    } else {
+        stop_animation(entry);
+        unload_entry_image(entry);
+    }
+    atomic_store(&entry->state, IMAGE_UPLOADED);
+}
+
+static bool has_upload_time(double start)
+{
+    return get_time_ms() - start + textures.upload_step_ms < UPLOAD_BUDGET_MS;
+}
+
+// uploads bands of the texture while there's time left in the frame, returns
+// true once it's complete
+static bool upload_entry_texture(ImageEntry *entry, double start)
+{
+    while(!upload_texture_rows(entry)) {
+        if(!has_upload_time(start)) return false;
+    }
+
+    finish_texture_upload(entry);
+    update_resident_memory(entry);
+    return true;
+}
+
+static Vector2 get_image_draw_size(int width, int height, int screen_width)
+{
+    if(width > screen_width) {
+        float scale = screen_width / (float)width;
+        return (Vector2){ screen_width, height * scale };
+    }
+
+    return (Vector2){ width, height };
+}
+
+static void remove_pending_upload(ImageEntry *entry)
+{
+    cancel_partial_upload(entry);
+
+    for(size_t i = 0; i < textures.uploads.count; i++) {
+        if(textures.uploads.items[i] != entry) continue;
+        textures.uploads.items[i] = textures.uploads.items[--textures.uploads.count];
+        break;
+    }
+}
+
+// uploads the pending textures of the images that were near the viewport in
+// the last frame, the ones on screen go first
+static void upload_pending_textures()
+{
+    double start = get_time_ms();
+
+    // the texture left half uploaded in the last frame goes first
+    ImageEntry *uploading = textures.uploading;
+    bool stepped = uploading != NULL;
+    if(uploading != NULL) {
+        if(!upload_entry_texture(uploading, start)) return;
+        remove_pending_upload(uploading);
+    }
+
+    for(int pass = 0; pass < 2; pass++) {
+        bool only_on_screen = pass == 0;
+
+        for(size_t i = 0; i < textures.uploads.count;) {
+            ImageEntry *entry = textures.uploads.items[i];
+
+            if(entry->state != IMAGE_DECODED) {
+                // it got evicted before being uploaded
+                textures.uploads.items[i] = textures.uploads.items[--textures.uploads.count];
+                continue;
+            }
+
+            bool visible = entry->last_visible_frame == textures.frame;
+            if(!visible || (only_on_screen && !entry->on_screen)) {
+                i++;
+                continue;
+            }
+
+            // the first step of the frame always goes, so the queue keeps moving
+            if(stepped && !has_upload_time(start)) return;
+            stepped = true;
+
+            if(!upload_entry_texture(entry, start)) return;
+            textures.uploads.items[i] = textures.uploads.items[--textures.uploads.count];
+        }
+    }
+}
+
+static uint64_t hash_url(const char *url)
+{
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+
+    for(const char *c = url; *c; c++) {
+        hash ^= (unsigned char)*c;
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+static void decode_url_escapes(char *str)
+{
+    char *dest = str;
+
+    for(char *c = str; *c; c++) {
+        if(c[0] == '%' && isxdigit(c[1]) && isxdigit(c[2])) {
+            char hex[3] = { c[1], c[2], '\0' };
+            *dest++ = strtol(hex, NULL, 16);
+            c += 2;
+        } else {
+            *dest++ = *c;
+        }
+    }
+
+    *dest = '\0';
+}
+
+// whether the first segment of a scheme-less reference is a host name, like
+// example.com/a.png, those are downloaded instead of looked up next to the
+// document, a segment is taken as a host when it ends in a label of letters
+static bool starts_with_host(const char *url)
+{
+    size_t length = strcspn(url, "/?#");
+    const char *dot = NULL;
+
+    for(size_t i = 0; i < length; i++) {
+        if(url[i] == '.') dot = url + i;
+        else if(!isalnum((unsigned char)url[i]) && url[i] != '-') return false;
+    }
+
+    if(dot == NULL || dot == url || url[length] != '/') return false;
+
+    size_t label_length = url + length - (dot + 1);
+    if(label_length < 2) return false;
+
+    for(const char *c = dot + 1; c < url + length; c++) {
+        if(!isalpha((unsigned char)*c)) return false;
+    }
+
+    return true;
+}
+
+// sets the path of the file for local images, or NULL when the url has to be
+// downloaded, relative paths are resolved against the document directory,
+// returns false when the path couldn't be allocated
+static bool resolve_local_path(const char *url, char **path)
+{
+    const char *file_scheme = "file://";
+    *path = NULL;
+
+    if(strncmp(url, file_scheme, strlen(file_scheme)) == 0) {
+        // only files of this machine, file:///path or file://localhost/path
+        const char *host = url + strlen(file_scheme);
+        const char *file = strchr(host, '/');
+        if(file == NULL) return true;
+
+        size_t host_length = file - host;
+        bool localhost = host_length == strlen("localhost") && strncasecmp(host, "localhost", host_length) == 0;
+        if(host_length != 0 && !localhost) return true;
+
+        *path = strdup(file);
+        if(*path == NULL) return false;
+        decode_url_escapes(*path);
+        return true;
+    }
+
+    // urls with a scheme, protocol relative urls like //host/a.png and host
+    // names without a scheme aren't local files
+    if(strstr(url, "://") != NULL || is_data_url(url)) return true;
+    if(strncmp(url, "//", 2) == 0 || starts_with_host(url)) return true;
+
+    if(url[0] == '/') {
+        *path = strdup(url);
+        return *path != NULL;
+    }
+
+    size_t size = strlen(loader.base_dir) + strlen(url) + 2;
+    *path = malloc(size);
+    if(*path == NULL) return false;
+    snprintf(*path, size, "%s/%s", loader.base_dir, url);
+    return true;
+}
+
+static void registry_grow()
+{
+    size_t buckets_count = registry.buckets_count ? registry.buckets_count * 2 : REGISTRY_INITIAL_BUCKETS;
+    ImageEntry **buckets = calloc(buckets_count, sizeof(ImageEntry*));
+
+    for(size_t i = 0; i < registry.buckets_count; i++) {
+        ImageEntry *entry = registry.buckets[i];
+
+        while(entry != NULL) {
+            ImageEntry *next = entry->next;
+            size_t bucket = hash_url(entry->url) % buckets_count;
+            entry->next = buckets[bucket];
+            buckets[bucket] = entry;
+            entry = next;
+        }
+    }
+
+    free(registry.buckets);
+    registry.buckets = buckets;
+    registry.buckets_count = buckets_count;
+}
+
+static void registry_remove(ImageEntry *entry)
+{
+    ImageEntry **it = &registry.buckets[hash_url(entry->url) % registry.buckets_count];
+
+    while(*it != NULL) {
+        if(*it == entry) {
+            *it = entry->next;
+            registry.entries_count--;
+            return;
+        }
+        it = &(*it)->next;
+    }
+}
+
+ImageEntry *image_loader_acquire(const char *url)
+{
+    registry.refs_count++;
+
+    if(registry.buckets_count > 0) {
+        ImageEntry *entry = registry.buckets[hash_url(url) % registry.buckets_count];
+
+        for(; entry != NULL; entry = entry->next) {
+            if(strcmp(entry->url, url) != 0) continue;
+            entry->refs_count++;
+            return entry;
+        }
+    }
+
+    if(registry.entries_count >= registry.buckets_count) registry_grow();
+
+    ImageEntry *entry = calloc(1, sizeof(ImageEntry));
+    entry->url = strdup(url);
+    bool resolved = resolve_local_path(url, &entry->path);
+    entry->refs_count = 1;
+    // it's as far as it gets until it's drawn
+    entry->priority = INT_MAX;
+
+    size_t bucket = hash_url(url) % registry.buckets_count;
+    entry->next = registry.buckets[bucket];
+    registry.buckets[bucket] = entry;
+    registry.entries_count++;
+
+    if(!resolved) {
+        atomic_store_explicit(&entry->state, IMAGE_FAILED, memory_order_release);
+        return entry;
+    }
+
+    image_loader_async_load(entry);
+    return entry;
+}
+
+static void free_image_entry(ImageEntry *entry)
+{
+    untrack_resident_image(entry);
+    remove_pending_upload(entry);
+
+    free(entry->url);
+    free(entry->path);
+    free(entry->source.data);
+    if(entry->texture.id != 0) UnloadTexture(entry->texture);
+    unload_entry_image(entry);
+    stop_animation(entry);
+    free(entry);
+}
+
+static void free_orphan_entry(ImageEntry *entry)
+{
+    for(size_t i = 0; i < registry.orphans.count; i++) {
+        if(registry.orphans.items[i] != entry) continue;
+        registry.orphans.items[i] = registry.orphans.items[--registry.orphans.count];
+        break;
+    }
+
+    free_image_entry(entry);
+}
+
+static void image_loader_release(ImageEntry *entry)
+{
+    registry.refs_count--;
+    if(--entry->refs_count > 0) return;
+
+    registry_remove(entry);
+
+    // the loader threads may still be writing into it
+    if(entry->loading && loader.running) {
+        untrack_resident_image(entry);
+        remove_pending_upload(entry);
+        da_append(&registry.orphans, entry);
+        return;
+    }
+
+    free_image_entry(entry);
+
+    if(registry.entries_count == 0) {
+        free(registry.buckets);
+        registry.buckets = NULL;
+        registry.buckets_count = 0;
+    }
+}
+
+void image_loader_begin_frame(int screen_width)
+{
+    loader.target_width = screen_width;
+
+    MPSCNode *link;
+    while((link = mpsc_queue_pop(&loader.completed))) {
+        ImageEntry *entry = mpsc_container_of(link, ImageEntry, completed_link);
+        entry->loading = false;
+
+        if(entry->refs_count == 0) {
+            free_orphan_entry(entry);
+            continue;
+        }
+
+        if(entry->state != IMAGE_DECODED) continue;
+
+        update_resident_memory(entry);
+        remove_pending_upload(entry);
+        da_append(&textures.uploads, entry);
+    }
+
+    // the visibility of the images is the one of the previous frame
+    upload_pending_textures();
+    advance_animations();
+
+    if(textures.priorities_changed) {
+        textures.priorities_changed = false;
+        atomic_fetch_add(&loader.priorities_generation, 1);
+        curl_multi_wakeup(loader.multi);
+    }
+
+    textures.frame++;
+}
+
+// the priority is the distance in pixels from the image to the viewport
+static void update_image_priority(ImageEntry *entry, Vector2 pos, Vector2 size, bool first_draw)
+{
+    int screen_height = GetScreenHeight();
+    int priority = 0;
+
+    if(pos.y + size.y < 0) {
+        priority = -(pos.y + size.y);
+    } else if(pos.y > screen_height) {
+        priority = pos.y - screen_height;
+    }
+
+    if(!first_draw && priority >= entry->priority) return;
+
+    if(priority != entry->priority) {
+        atomic_store_explicit(&entry->priority, priority, memory_order_relaxed);
+        textures.priorities_changed = true;
+    }
+}
+
+Vector2 draw_image_node(Vector2 pos, int screen_width, ImageNode *node)
+{
+    ImageEntry *entry = node->entry;
+    if(entry == NULL) return Vector2Zero();
+
+    enum ImageState state = atomic_load_explicit(&entry->state, memory_order_acquire);
+    int width = atomic_load_explicit(&entry->width, memory_order_acquire);
+    int height = atomic_load_explicit(&entry->height, memory_order_relaxed);
+
+    if(state == IMAGE_FAILED) return Vector2Zero();
+
+    // the same entry can be drawn by several nodes in the same frame, so
+    // the visibility and the priority are the ones of the closest node
+    bool first_draw = entry->last_drawn_frame != textures.frame;
+    entry->last_drawn_frame = textures.frame;
+
+    // the size is known as soon as the header of the image is downloaded,
+    // until then the image takes no space but its position is enough to
+    // know how close it is to the viewport
+    if(width == 0) {
+        if(state == IMAGE_QUEUED || state == IMAGE_FETCHING) {
+            update_image_priority(entry, pos, Vector2Zero(), first_draw);
+        }
+        return Vector2Zero();
+    }
+
+    Vector2 image_size = get_image_draw_size(width, height, screen_width);
+    bool near_viewport = is_near_viewport(pos, image_size);
+
+    if(near_viewport) {
+        bool on_screen = pos.y + image_size.y >= 0 && pos.y <= GetScreenHeight();
+        if(entry->last_visible_frame != textures.frame) entry->on_screen = false;
+
+        entry->last_visible_frame = textures.frame;
+        entry->on_screen |= on_screen;
+    }
+
+    if(state == IMAGE_QUEUED || state == IMAGE_FETCHING || entry->upgrading) {
+        update_image_priority(entry, pos, image_size, first_draw);
+    }
+
+    // the completion of the last load may not have been received yet, the
+    // entry can't be queued again until then
+    if(state == IMAGE_EVICTED && near_viewport && !entry->loading) {
+        image_loader_async_load(entry);
+    }
+
+    // the window got wider than the size the image was decoded at
+    int display_width = width < screen_width ? width : screen_width;
+    if(state == IMAGE_UPLOADED && near_viewport && entry->texture.width < display_width && !entry->upgrading) {
+        atomic_store(&entry->upgrading, true);
+        queue_image_load(entry);
+    }
+
+    // while a higher resolution version is waiting to be uploaded we keep
+    // drawing the old texture
+    if(entry->texture.id != 0) {
+        float scale = image_size.x / entry->texture.width;
+        DrawTextureEx(entry->texture, pos, 0, scale, WHITE);
+    } else {
+        // the space is reserved so nothing moves once the image is ready
+        DrawRectangleV(pos, image_size, IMAGE_PLACEHOLDER_COLOR);
+    }
+
+    return image_size;
+}
+
+Vector2 measure_image_node(int screen_width, ImageNode *node)
+{
+    ImageEntry *entry = node->entry;
+    if(entry == NULL) return Vector2Zero();
+
+    enum ImageState state = atomic_load_explicit(&entry->state, memory_order_acquire);
+    int width = atomic_load_explicit(&entry->width, memory_order_acquire);
+    int height = atomic_load_explicit(&entry->height, memory_order_relaxed);
+
+    if(state == IMAGE_FAILED || width == 0) return Vector2Zero();
+
+    return get_image_draw_size(width, height, screen_width);
+}
+
+void release_image_node(ImageNode *node)
+{
+    if(node->entry != NULL) image_loader_release(node->entry);
+    node->entry = NULL;
+}
+
+void free_image_node(ImageNode *node)
+{
+    free(node->alt);
+    free(node->url);
+    if(node->entry != NULL) image_loader_release(node->entry);
+}
+
+// NOTE: this should be called before freeing the image entries, since the
+// workers may still be writing into them
+void image_loader_destroy()
+{
+    TraceLog(LOG_INFO, "IMAGE: %zu unique images for %zu references",
+             registry.entries_count, registry.refs_count);
+
+    pthread_mutex_lock(&loader.decode_lock);
+    loader.running = false;
+    pthread_cond_broadcast(&loader.decode_cond);
+    pthread_mutex_unlock(&loader.decode_lock);
+
+    curl_multi_wakeup(loader.multi);
+
+    pthread_join(loader.downloader, NULL);
+    for(size_t i = 0; i < loader.decoders_count; i++) {
+        pthread_join(loader.decoders[i], NULL);
+        if(loader.isolated) decoder_process_stop(&loader.processes[i]);
+    }
+
+    TraceLog(LOG_INFO, "IMAGE: Downloaded %zu bytes with %zu buffer reallocations",
+             loader.downloaded_bytes, loader.buffer_reallocs);
+
+    for(size_t i = 0; i < loader.decode.count; i++) {
+        if(!loader.decode.items[i].keep_data) free(loader.decode.items[i].chunk.data);
+    }
+    da_free(&loader.decode);
+
+    // the decoders may send images back after the downloader stopped
+    for(size_t i = 0; i < loader.fetches.count; i++) free(loader.fetches.items[i]);
+    da_free(&loader.fetches);
+
+    curl_multi_cleanup(loader.multi);
+    curl_global_cleanup();
+    image_cache_destroy();
+
+    // the workers are stopped, so the released entries can be freed now
+    for(size_t i = 0; i < registry.orphans.count; i++) {
+        free_image_entry(registry.orphans.items[i]);
+    }
+    da_free(&registry.orphans);
+
+    // the entries still own their textures, they get unloaded once the last
+    // node referencing them is freed
+    for(size_t i = 0; i < textures.resident.count; i++) {
+        textures.resident.items[i]->resident = false;
+    }
+    da_free(&textures.resident);
+    da_free(&textures.uploads);
+    da_free(&textures.animations);
+    textures = (TextureManager){ .frame = 1 };
+
+    free(loader.base_dir);
+    loader.base_dir = NULL;
+
+    pthread_cond_destroy(&loader.decode_cond);
+    pthread_mutex_destroy(&loader.decode_lock);
 }
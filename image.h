@@ -1,25 +1,116 @@
 #ifndef IMAGE_H_
 #define IMAGE_H_
 
-typedef struct ImageNode {
-    Texture2D texture;
-    Image image;
-    char *alt;
-    char *url;
-    bool loading_image;
-    bool texture_loaded;
-} ImageNode;
+#include <stdatomic.h>
+#include "mpsc_queue.h"
+
+// default amount of memory used by the decoded images and their textures,
+// it can be changed with the MD_RAYDER_IMAGE_MEMORY_MB environment variable
+#define IMAGE_MEMORY_BUDGET (256 * 1024 * 1024)
+// default maximum size of a downloaded image, bigger ones are aborted so a
+// hostile url can't exhaust the memory, it can be changed with the
+// MD_RAYDER_IMAGE_MAX_MB environment variable
+#define IMAGE_MAX_DOWNLOAD_SIZE (64 * 1024 * 1024)
+
+// queued -> fetching -> decoded -> uploaded, with failed as the end of any
+// unsuccessful load
+enum ImageState {
+    IMAGE_QUEUED,
+    IMAGE_FETCHING, // being downloaded, read from the cache or decoded
+    IMAGE_DECODED, // the pixels are in ram waiting to be uploaded
+    IMAGE_UPLOADED,
+    IMAGE_EVICTED, // unloaded to save memory, it gets loaded again when it's close to the screen
+    IMAGE_FAILED,
+};
+
+// playback of an animated image, only touched by the render thread
+typedef struct ImageAnimation {
+    // all the frames one after the other, the texture shows one of them
+    Image frames;
+    size_t mapping_size;
+    int frames_count;
+    int *delays; // how long each frame is shown in milliseconds
+    int current_frame;
+    double next_frame_time;
+    // set while the image is off the screen, the animation doesn't advance
+    bool paused;
+} ImageAnimation;
 
 typedef struct ImageChunk {
     char *data;
     size_t size;
 } ImageChunk;
 
-void image_loader_init();
+// an image shared by all the nodes that reference the same url, so every url
+// is downloaded, decoded and uploaded only once
+typedef struct ImageEntry {
+    Texture2D texture;
+    Image image;
+    // size of the shared memory holding the pixels when they come from a
+    // decoder process, 0 when they're allocated in this process
+    size_t image_mapping_size;
+    // animated images have all their frames in the image, and the delay of
+    // each one, they're moved to the animation once the texture is uploaded
+    int image_frames_count;
+    int *image_delays;
+    ImageAnimation animation;
+    char *url;
+    // path of the file for local images, NULL when the image is downloaded
+    char *path;
+    // the loader threads publish their results through the state, the image
+    // is owned by the render thread once the state is IMAGE_DECODED
+    _Atomic int state;
+    // size of the original image, known after its header is downloaded, the
+    // texture may be smaller since images wider than the screen are downscaled
+    _Atomic int width;
+    _Atomic int height;
+    // a higher resolution version is being decoded since the window got wider
+    atomic_bool upgrading;
+    // distance in pixels to the viewport, the closest images are loaded first
+    _Atomic int priority;
+    size_t load_order;
+    // when the last load was requested, in milliseconds
+    double requested_at;
+    // links for the queues of the loader
+    MPSCNode pending_link;
+    MPSCNode completed_link;
+    // encoded bytes, only kept when they can't be read back from the disk cache
+    ImageChunk source;
+    // bytes used by either the texture or the decoded image
+    size_t memory_size;
+    unsigned long last_visible_frame;
+    unsigned long last_drawn_frame;
+    // whether the image was inside the screen the last time it was visible
+    bool on_screen;
+    bool resident;
+
+    // these are only touched by the render thread
+    size_t refs_count;
+    // the loader is working on the image, the entry can't be freed until it's done
+    bool loading;
+    struct ImageEntry *next; // next entry in the same bucket of the registry
+} ImageEntry;
+
+typedef struct ImageNode {
+    char *alt;
+    // the render thread acquires the entry of the url, the documents can be
+    // parsed in the background but the registry can't be touched from there
+    char *url;
+    ImageEntry *entry;
+} ImageNode;
+
+// relative image paths are resolved against the directory of the document
+void image_loader_init(const char *document_path);
 void image_loader_destroy();
+void image_loader_begin_frame(int screen_width);
 void free_image_node(ImageNode *node);
-void image_loader_async_load(ImageNode *node);
+// releases the entry of the node, the node can be freed by any thread after it
+void release_image_node(ImageNode *node);
+// returns the entry of the url, starting to load it if it's the first reference
+ImageEntry *image_loader_acquire(const char *url);
 
 Vector2 draw_image_node(Vector2 pos, int screen_width, ImageNode *node);
+// size the node is drawn at, without drawing it nor loading its image
+Vector2 measure_image_node(int screen_width, ImageNode *node);
 
 #endif
@@ -0,0 +1,413 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <curl/curl.h>
+
+#include "raylib.h"
+#include "lexer.h"
+#include "image_cache.h"
+
+// when no freshness information is given we use a fraction of the time since
+// the image was last modified, like browsers do (RFC 9111 4.2.2)
+#define HEURISTIC_FRESHNESS_FRACTION 0.1
+#define HEURISTIC_FRESHNESS_MAX (24 * 60 * 60)
+// after evicting we leave some room so we don't evict on every store
+#define EVICTION_TARGET_SIZE (IMAGE_CACHE_MAX_SIZE / 10 * 9)
+
+typedef struct CacheFile {
+    char name[32];
+    time_t last_used;
+    size_t size;
+} CacheFile;
+
+typedef struct CacheFiles {
+    CacheFile *items;
+    size_t count;
+    size_t capacity;
+} CacheFiles;
+
+typedef struct ImageCache {
+    bool enabled;
+    char dir[4096];
+    size_t total_size;
+    pthread_mutex_t lock;
+} ImageCache;
+
+static ImageCache cache = {0};
+
+// enough for the directory plus the name of an entry
+#define CACHE_PATH_SIZE (sizeof(cache.dir) + 32)
+
+static bool make_dirs(char *path)
+{
+    for(char *p = path + 1; *p; p++) {
+        if(*p != '/') continue;
+
+        *p = '\0';
+        int res = mkdir(path, 0755);
+        *p = '/';
+
+        if(res == -1 && errno != EEXIST) return false;
+    }
+
+    return mkdir(path, 0755) == 0 || errno == EEXIST;
+}
+
+// FNV-1a, the url is used as the key of the entry
+static uint64_t hash_url(const char *url)
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    for(const char *c = url; *c; c++) {
+        hash ^= (unsigned char)*c;
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+static void get_entry_path(char *dest, size_t dest_size, const char *url, const char *ext)
+{
+    snprintf(dest, dest_size, "%s/%016llx.%s", cache.dir, (unsigned long long)hash_url(url), ext);
+}
+
+static int compare_cache_files(const void *a, const void *b)
+{
+    const CacheFile *fa = a;
+    const CacheFile *fb = b;
+
+    if(fa->last_used < fb->last_used) return -1;
+    if(fa->last_used > fb->last_used) return 1;
+    return 0;
+}
+
+static void list_cache_files(CacheFiles *files)
+{
+    DIR *dir = opendir(cache.dir);
+    if(dir == NULL) return;
+
+    struct dirent *ent;
+    while((ent = readdir(dir))) {
+        size_t len = strlen(ent->d_name);
+        if(len >= sizeof(((CacheFile *)0)->name) || len < 5) continue;
+        if(strcmp(ent->d_name + len - 5, ".data") != 0) continue;
+
+        CacheFile file = {0};
+        strcpy(file.name, ent->d_name);
+
+        char path[CACHE_PATH_SIZE];
+        snprintf(path, sizeof(path), "%s/%s", cache.dir, file.name);
+
+        struct stat st;
+        if(stat(path, &st) == -1) continue;
+
+        file.last_used = st.st_mtime;
+        file.size = st.st_size;
+        da_append(files, file);
+    }
+
+    closedir(dir);
+}
+
+// should be called with the cache lock held
+static void evict_entries()
+{
+    CacheFiles files = {0};
+    list_cache_files(&files);
+    qsort(files.items, files.count, sizeof(CacheFile), compare_cache_files);
+
+    for(size_t i = 0; i < files.count && cache.total_size > EVICTION_TARGET_SIZE; i++) {
+        char path[CACHE_PATH_SIZE];
+        snprintf(path, sizeof(path), "%s/%s", cache.dir, files.items[i].name);
+        remove(path);
+
+        // same name with the .meta extension
+        strcpy(path + strlen(path) - 4, "meta");
+        remove(path);
+
+        cache.total_size -= files.items[i].size;
+    }
+
+    da_free(&files);
+}
+
+bool image_cache_init()
+{
+    const char *xdg_cache = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+
+    if(xdg_cache && xdg_cache[0] == '/') {
+        snprintf(cache.dir, sizeof(cache.dir), "%s/markdown-rayder/images", xdg_cache);
+    } else if(home) {
+        snprintf(cache.dir, sizeof(cache.dir), "%s/.cache/markdown-rayder/images", home);
+    } else {
+        TraceLog(LOG_WARNING, "IMAGE CACHE: Couldn't find a cache directory, the cache is disabled");
+        return false;
+    }
+
+    if(!make_dirs(cache.dir)) {
+        TraceLog(LOG_WARNING, "IMAGE CACHE: Couldn't create %s: %s", cache.dir, strerror(errno));
+        return false;
+    }
+
+    pthread_mutex_init(&cache.lock, NULL);
+
+    CacheFiles files = {0};
+    list_cache_files(&files);
+    for(size_t i = 0; i < files.count; i++) {
+        cache.total_size += files.items[i].size;
+    }
+    da_free(&files);
+
+    cache.enabled = true;
+    return true;
+}
+
+void image_cache_destroy()
+{
+    if(!cache.enabled) return;
+
+    cache.enabled = false;
+    pthread_mutex_destroy(&cache.lock);
+}
+
+bool image_cache_lookup(const char *url, CacheMetadata *meta)
+{
+    if(!cache.enabled) return false;
+
+    char path[CACHE_PATH_SIZE];
+    get_entry_path(path, sizeof(path), url, "meta");
+
+    FILE *file = fopen(path, "r");
+    if(file == NULL) return false;
+
+    cache_metadata_reset(meta);
+
+    // the url is stored in the first line to detect hash collisions
+    bool found = false;
+    char line[4096];
+    while(fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "\n")] = '\0';
+
+        if(strncmp(line, "url ", 4) == 0) {
+            found = strcmp(line + 4, url) == 0;
+            if(!found) break;
+        } else if(strncmp(line, "etag ", 5) == 0) {
+            snprintf(meta->etag, sizeof(meta->etag), "%s", line + 5);
+        } else if(strncmp(line, "last_modified ", 14) == 0) {
+            snprintf(meta->last_modified, sizeof(meta->last_modified), "%s", line + 14);
+        } else if(strncmp(line, "expires ", 8) == 0) {
+            meta->expires = strtoll(line + 8, NULL, 10);
+        }
+    }
+
+    fclose(file);
+    return found;
+}
+
+bool image_cache_is_fresh(CacheMetadata *meta)
+{
+    return time(NULL) < meta->expires;
+}
+
+char *image_cache_read(const char *url, size_t *size)
+{
+    if(!cache.enabled) return NULL;
+
+    char path[CACHE_PATH_SIZE];
+    get_entry_path(path, sizeof(path), url, "data");
+
+    FILE *file = fopen(path, "rb");
+    if(file == NULL) return NULL;
+
+    fseek(file, 0, SEEK_END);
+    long file_size = ftell(file);
+    rewind(file);
+
+    char *data = malloc(file_size + 1);
+    if(data == NULL || fread(data, 1, file_size, file) != (size_t)file_size) {
+        TraceLog(LOG_ERROR, "IMAGE CACHE: Couldn't read %s", path);
+        free(data);
+        fclose(file);
+        return NULL;
+    }
+    data[file_size] = '\0';
+    fclose(file);
+
+    // the modification time of the data is used as the last use time for the LRU
+    utimensat(AT_FDCWD, path, NULL, 0);
+
+    *size = file_size;
+    return data;
+}
+
+static bool write_file_atomically(const char *path, const char *data, size_t size)
+{
+    char tmp_path[CACHE_PATH_SIZE + 4];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    FILE *file = fopen(tmp_path, "wb");
+    if(file == NULL) return false;
+
+    bool ok = fwrite(data, 1, size, file) == size;
+    ok = fclose(file) == 0 && ok;
+
+    if(!ok || rename(tmp_path, path) == -1) {
+        remove(tmp_path);
+        return false;
+    }
+
+    return true;
+}
+
+static bool write_metadata(const char *url, CacheMetadata *meta)
+{
+    char path[CACHE_PATH_SIZE];
+    get_entry_path(path, sizeof(path), url, "meta");
+
+    char *contents = NULL;
+    size_t contents_size = 0;
+    FILE *stream = open_memstream(&contents, &contents_size);
+    if(stream == NULL) return false;
+
+    fprintf(stream, "url %s\n", url);
+    if(meta->etag[0]) fprintf(stream, "etag %s\n", meta->etag);
+    if(meta->last_modified[0]) fprintf(stream, "last_modified %s\n", meta->last_modified);
+    fprintf(stream, "expires %lld\n", (long long)meta->expires);
+    fclose(stream);
+
+    bool ok = write_file_atomically(path, contents, contents_size);
+    free(contents);
+
+    return ok;
+}
+
+bool image_cache_store(const char *url, const char *data, size_t size, CacheMetadata *meta)
+{
+    if(!cache.enabled || meta->no_store || size > IMAGE_CACHE_MAX_SIZE) return false;
+
+    char path[CACHE_PATH_SIZE];
+    get_entry_path(path, sizeof(path), url, "data");
+
+    pthread_mutex_lock(&cache.lock);
+
+    struct stat st;
+    size_t old_size = stat(path, &st) == 0 ? (size_t)st.st_size : 0;
+
+    bool stored = write_file_atomically(path, data, size) && write_metadata(url, meta);
+    if(!stored) {
+        TraceLog(LOG_WARNING, "IMAGE CACHE: Couldn't store %s", url);
+        remove(path);
+        size = 0;
+    }
+
+    cache.total_size += size - old_size;
+    if(cache.total_size > IMAGE_CACHE_MAX_SIZE) {
+        evict_entries();
+    }
+
+    pthread_mutex_unlock(&cache.lock);
+
+    return stored;
+}
+
+void image_cache_update_metadata(const char *url, CacheMetadata *meta)
+{
+    if(!cache.enabled) return;
+
+    pthread_mutex_lock(&cache.lock);
+    write_metadata(url, meta);
+    pthread_mutex_unlock(&cache.lock);
+}
+
+void cache_metadata_reset(CacheMetadata *meta)
+{
+    *meta = (CacheMetadata){0};
+    meta->max_age = -1;
+}
+
+// copies the value of the header removing the surrounding whitespace
+static void copy_header_value(char *dest, size_t dest_size, const char *value, size_t size)
+{
+    while(size > 0 && isspace(*value)) {
+        value++;
+        size--;
+    }
+    while(size > 0 && isspace(value[size - 1])) size--;
+
+    if(size >= dest_size) size = dest_size - 1;
+    memcpy(dest, value, size);
+    dest[size] = '\0';
+}
+
+static bool is_header(const char *line, size_t size, const char *name)
+{
+    size_t len = strlen(name);
+    return size > len && strncasecmp(line, name, len) == 0 && line[len] == ':';
+}
+
+void cache_metadata_parse_header(CacheMetadata *meta, const char *line, size_t size)
+{
+    // every response starts with the status line, e.g. after a redirect
+    if(size > 5 && strncmp(line, "HTTP/", 5) == 0) {
+        cache_metadata_reset(meta);
+        return;
+    }
+
+    if(is_header(line, size, "ETag")) {
+        copy_header_value(meta->etag, sizeof(meta->etag), line + 5, size - 5);
+    } else if(is_header(line, size, "Last-Modified")) {
+        copy_header_value(meta->last_modified, sizeof(meta->last_modified), line + 14, size - 14);
+    } else if(is_header(line, size, "Date")) {
+        char date[64];
+        copy_header_value(date, sizeof(date), line + 5, size - 5);
+        meta->date = curl_getdate(date, NULL);
+    } else if(is_header(line, size, "Cache-Control")) {
+        char value[256];
+        copy_header_value(value, sizeof(value), line + 14, size - 14);
+
+        char *directives = value;
+        char *directive;
+        while((directive = strsep(&directives, ","))) {
+            while(isspace(*directive)) directive++;
+
+            if(strncasecmp(directive, "max-age=", 8) == 0) {
+                meta->max_age = strtol(directive + 8, NULL, 10);
+            } else if(strcasecmp(directive, "no-store") == 0) {
+                meta->no_store = true;
+            } else if(strcasecmp(directive, "no-cache") == 0) {
+                meta->no_cache = true;
+            }
+        }
+    }
+}
+
+void cache_metadata_finish(CacheMetadata *meta)
+{
+    time_t now = time(NULL);
+
+    if(meta->no_cache) {
+        meta->expires = 0;
+    } else if(meta->max_age >= 0) {
+        meta->expires = now + meta->max_age;
+    } else if(meta->last_modified[0]) {
+        time_t last_modified = curl_getdate(meta->last_modified, NULL);
+        time_t date = meta->date > 0 ? meta->date : now;
+        double freshness = (date - last_modified) * HEURISTIC_FRESHNESS_FRACTION;
+
+        if(freshness < 0) freshness = 0;
+        if(freshness > HEURISTIC_FRESHNESS_MAX) freshness = HEURISTIC_FRESHNESS_MAX;
+
+        meta->expires = now + freshness;
+    } else {
+        meta->expires = 0;
+    }
+}
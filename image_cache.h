@@ -0,0 +1,42 @@
+#ifndef IMAGE_CACHE_H_
+#define IMAGE_CACHE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+// maximum size in bytes of all the cached images, the least recently used
+// ones get evicted once this is exceeded
+#define IMAGE_CACHE_MAX_SIZE (512 * 1024 * 1024)
+
+typedef struct CacheMetadata {
+    char etag[256];
+    char last_modified[64];
+    time_t expires;
+
+    // these are only used while parsing the response headers
+    time_t date;
+    long max_age; // -1 when the response didn't specify it
+    bool no_store;
+    bool no_cache;
+} CacheMetadata;
+
+bool image_cache_init();
+void image_cache_destroy();
+
+// returns true when there's an entry for the url and fills its metadata
+bool image_cache_lookup(const char *url, CacheMetadata *meta);
+bool image_cache_is_fresh(CacheMetadata *meta);
+// reads the cached bytes of the url into a malloc'd buffer
+char *image_cache_read(const char *url, size_t *size);
+// returns false when the image couldn't be stored
+bool image_cache_store(const char *url, const char *data, size_t size, CacheMetadata *meta);
+// used after a successful revalidation to extend the life of the entry
+void image_cache_update_metadata(const char *url, CacheMetadata *meta);
+
+void cache_metadata_reset(CacheMetadata *meta);
+void cache_metadata_parse_header(CacheMetadata *meta, const char *line, size_t size);
+// computes the expiration time once all the headers have been parsed
+void cache_metadata_finish(CacheMetadata *meta);
+
+#endif
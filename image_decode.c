@@ -0,0 +1,149 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "image_decode.h"
+
+static size_t get_pixels_size(Image image)
+{
+    size_t size = 0;
+    int width = image.width;
+    int height = image.height;
+
+    for(int i = 0; i < image.mipmaps; i++) {
+        size += GetPixelDataSize(width, height, image.format);
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+
+    return size;
+}
+
+size_t get_decoded_image_size(const DecodedImage *decoded)
+{
+    int frames_count = decoded->frames_count > 1 ? decoded->frames_count : 1;
+    return get_pixels_size(decoded->image) * frames_count;
+}
+
+// every frame is resized on its own so the rows of one don't bleed into the next
+static void resize_animation(Image *image, int frames_count, int width, int height)
+{
+    size_t frame_size = GetPixelDataSize(image->width, image->height, image->format);
+    size_t resized_frame_size = GetPixelDataSize(width, height, image->format);
+
+    unsigned char *frames = malloc(resized_frame_size * frames_count);
+    if(frames == NULL) {
+        TraceLog(LOG_ERROR, "Couldn't allocate memory to resize the animation");
+        return;
+    }
+
+    for(int i = 0; i < frames_count; i++) {
+        Image frame = *image;
+        frame.data = (unsigned char *)image->data + frame_size * i;
+
+        Image resized = ImageCopy(frame);
+        ImageResize(&resized, width, height);
+        memcpy(frames + resized_frame_size * i, resized.data, resized_frame_size);
+        UnloadImage(resized);
+    }
+
+    UnloadImage(*image);
+    image->data = frames;
+    image->width = width;
+    image->height = height;
+}
+
+DecodedImage decode_image(const char *ext, const char *data, size_t size, int target_width, bool mipmaps)
+{
+    DecodedImage decoded = { .frames_count = 1 };
+
+    if(strcmp(ext, ".gif") == 0) {
+        decoded.image = LoadImageAnimFromMemory(ext, (const unsigned char *)data, size, &decoded.frames_count);
+    } else {
+        decoded.image = LoadImageFromMemory(ext, (const unsigned char *)data, size);
+    }
+
+    Image *image = &decoded.image;
+    decoded.width = image->width;
+    decoded.height = image->height;
+
+    if(!IsImageValid(*image)) return decoded;
+
+    // there's no point on keeping more pixels than the ones we display
+    bool too_wide = target_width > 0 && image->width > target_width;
+    int height = (int)((float)image->height * target_width / image->width);
+    // wide and short images would round to an empty one
+    if(height < 1) height = 1;
+
+    if(decoded.frames_count > 1) {
+        if(too_wide) resize_animation(image, decoded.frames_count, target_width, height);
+        return decoded;
+    }
+
+    if(too_wide) ImageResize(image, target_width, height);
+    if(mipmaps) ImageMipmaps(image);
+
+    return decoded;
+}
+
+static unsigned int read_u16_le(const unsigned char *p) { return p[0] | (p[1] << 8); }
+
+// skips the data sub-blocks that follow extensions and images
+static size_t skip_gif_sub_blocks(const unsigned char *data, size_t size, size_t pos)
+{
+    while(pos < size && data[pos] != 0) pos += data[pos] + 1;
+    return pos + 1;
+}
+
+int read_gif_delays(const char *buf, size_t size, int **delays)
+{
+    const unsigned char *data = (const unsigned char *)buf;
+    *delays = NULL;
+
+    if(size < 13 || memcmp(data, "GIF", 3) != 0) return 0;
+
+    size_t pos = 13;
+    // global color table
+    if(data[10] & 0x80) pos += 3 * (1 << ((data[10] & 7) + 1));
+
+    int frames_count = 0;
+    int capacity = 0;
+    int delay = 0;
+
+    while(pos < size) {
+        unsigned char block = data[pos++];
+
+        if(block == 0x21 && pos < size) {
+            unsigned char label = data[pos++];
+
+            // graphic control extension, the delay is in hundredths of a second
+            if(label == 0xF9 && pos + 4 < size && data[pos] == 4) {
+                delay = read_u16_le(data + pos + 2) * 10;
+            }
+
+            pos = skip_gif_sub_blocks(data, size, pos);
+        } else if(block == 0x2C && pos + 9 < size) {
+            unsigned char flags = data[pos + 8];
+            pos += 9;
+            // local color table
+            if(flags & 0x80) pos += 3 * (1 << ((flags & 7) + 1));
+            // lzw minimum code size
+            pos = skip_gif_sub_blocks(data, size, pos + 1);
+
+            if(frames_count == capacity) {
+                capacity = capacity ? capacity * 2 : 16;
+                int *items = realloc(*delays, capacity * sizeof(int));
+                if(items == NULL) break;
+                *delays = items;
+            }
+
+            // browsers do the same with the delays that are too short
+            (*delays)[frames_count++] = delay > 10 ? delay : ANIMATION_DEFAULT_DELAY_MS;
+            delay = 0;
+        } else {
+            // the trailer or a corrupted block
+            break;
+        }
+    }
+
+    return frames_count;
+}
@@ -0,0 +1,34 @@
+#ifndef IMAGE_DECODE_H_
+#define IMAGE_DECODE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "raylib.h"
+
+// gifs that don't specify a delay, or one too short, show every frame this long
+#define ANIMATION_DEFAULT_DELAY_MS 100
+
+typedef struct DecodedImage {
+    // the frames of animated images go one after the other, like LoadImageAnim does
+    Image image;
+    int frames_count;
+    // size of the original image
+    int width;
+    int height;
+    // size of the shared memory holding the pixels when they come from a
+    // decoder process, 0 when they're allocated in this process
+    size_t mapping_size;
+} DecodedImage;
+
+// decodes the image downscaling it to target_width (0 keeps its size) and
+// generating its mipmaps if asked, the frames of animations have no mipmaps
+DecodedImage decode_image(const char *ext, const char *data, size_t size, int target_width, bool mipmaps);
+// bytes used by the pixels of all the frames and mipmaps
+size_t get_decoded_image_size(const DecodedImage *decoded);
+
+// reads the delay of every frame of a gif into a malloc'd array, returns the
+// number of frames
+int read_gif_delays(const char *data, size_t size, int **delays);
+
+#endif
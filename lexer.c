@@ -6,28 +6,25 @@
 #include <stdio.h>
 #include <sys/types.h>
 #include <sys/stat.h>
-#include "raylib.h"
 #include "lexer.h"
 
-Lexer lexer = {0};
-
-char *load_file_contents(const char *path)
+static char *load_file_contents(const char *path)
 {
     struct stat buf_stat;
     if(stat(path, &buf_stat) == -1) {
-        TraceLog(LOG_ERROR, "Couldn't open file %s: %s", path, strerror(errno));
+        fprintf(stderr, "ERROR: Couldn't open file %s: %s\n", path, strerror(errno));
         return NULL;
     }
 
     if((buf_stat.st_mode & S_IFMT) != S_IFREG) {
-        TraceLog(LOG_ERROR, "%s is not a valid file path", path);
+        fprintf(stderr, "ERROR: %s is not a valid file path\n", path);
         return NULL;
     }
 
     FILE *file = fopen(path, "r");
 
     if(file == NULL) {
-        TraceLog(LOG_ERROR, "Couldn't open file %s: %s\n", path, strerror(errno));
+        fprintf(stderr, "ERROR: Couldn't open file %s: %s\n", path, strerror(errno));
         return NULL;
     }
 
@@ -35,10 +32,16 @@ char *load_file_contents(const char *path)
     long file_size = ftell(file);
     rewind(file);
 
+    if(file_size > LEXER_MAX_SIZE) {
+        fprintf(stderr, "ERROR: %s is too big to be lexed\n", path);
+        fclose(file);
+        return NULL;
+    }
+
     char *text = calloc(sizeof(char), file_size + 1);
 
     if(text == NULL) {
-        TraceLog(LOG_ERROR, "Couldn't allocate memory to contain the file");
+        fprintf(stderr, "ERROR: Couldn't allocate memory to contain the file\n");
         return NULL;
     }
 
@@ -50,61 +53,71 @@ char *load_file_contents(const char *path)
     return text;
 }
 
-bool lexer_init(const char *file_path)
+bool lexer_init(Lexer *lexer, const char *file_path)
 {
-    lexer.buf = load_file_contents(file_path);
-    lexer.cursor = 0;
-
-    if(!lexer.buf) {
+    char *buf = load_file_contents(file_path);
+    if(!buf) {
         return false;
     }
 
+    lexer_init_buffer(lexer, buf, strlen(buf));
+    lexer->owns_buf = true;
     return true;
 }
 
-char lexer_get_char(int pos)
+void lexer_init_buffer(Lexer *lexer, const char *buf, size_t size)
+{
+    *lexer = (Lexer){0};
+    lexer->buf = buf;
+    lexer->buf_size = size;
+    lexer->copy_lexemes = true;
+    lexer->bracket_scan = (LineScan){ -1, -1 };
+    lexer->paren_scan = (LineScan){ -1, -1 };
+}
+
+static char lexer_get_char(Lexer *lexer, int pos)
 {
     if(pos < 0) pos = 0;
 
-    if(pos >= strlen(lexer.buf)) {
+    if(pos >= lexer->buf_size) {
         return EOF;
     }
 
-    return lexer.buf[pos];
+    return lexer->buf[pos];
 }
 
-char lexer_get_and_advance()
+static char lexer_get_and_advance(Lexer *lexer)
 {
-    return lexer_get_char(lexer.cursor++);
+    return lexer_get_char(lexer, lexer->cursor++);
 }
 
-char lexer_peek_n_char(int n)
+static char lexer_peek_n_char(Lexer *lexer, int n)
 {
-    return lexer_get_char(lexer.cursor + n);
+    return lexer_get_char(lexer, lexer->cursor + n);
 }
 
-bool lexer_is_next_char(char c) {
-    return lexer_peek_n_char(0) == c;
+static bool lexer_is_next_char(Lexer *lexer, char c) {
+    return lexer_peek_n_char(lexer, 0) == c;
 }
 
-void lexer_advance()
+static void lexer_advance(Lexer *lexer)
 {
-    lexer.cursor++;
+    lexer->cursor++;
 }
 
-void lexer_advance_n(int n)
+static void lexer_advance_n(Lexer *lexer, int n)
 {
-    lexer.cursor += n;
+    lexer->cursor += n;
 }
 
-void lexer_rewind(int n) {
-    lexer.cursor -= n;
-    if(lexer.cursor < 0) {
-        lexer.cursor = 0;
+static void lexer_rewind(Lexer *lexer, int n) {
+    lexer->cursor -= n;
+    if(lexer->cursor < 0) {
+        lexer->cursor = 0;
     }
 }
 
-enum TokenType get_header_type(int level)
+static enum TokenType get_header_type(int level)
 {
     switch(level) {
         case 1: return TKN_HEADER_1;
@@ -118,13 +131,34 @@ enum TokenType get_header_type(int level)
     }
 }
 
+// returns the position of the closing char, or of the newline or the end of
+// the file when the line doesn't have it
+static int lexer_find_closing_char(Lexer *lexer, char closing)
+{
+    LineScan *scan = closing == ']' ? &lexer->bracket_scan : &lexer->paren_scan;
+    int start = lexer->cursor;
+
+    if(start >= scan->start && start <= scan->end) {
+        return scan->end;
+    }
+
+    int end = start;
+    char c = lexer_get_char(lexer, end);
+    while(c != closing && c != '\n' && c != EOF) {
+        c = lexer_get_char(lexer, ++end);
+    }
+
+    *scan = (LineScan){ start, end };
+    return end;
+}
+
 // returns true for any char that belong to an inline token
-bool is_special_char(char c)
+static bool is_special_char(char c)
 {
     return c == '\n' || c == EOF || c == '*' || c == '`' || c == '_' || c == '[';
 }
 
-void copy_buf_to_string(String *str, char *buf, size_t buf_size)
+static void copy_buf_to_string(String *str, const char *buf, size_t buf_size)
 {
     str->count = 0;
     for(size_t i = 0; i < buf_size; i++) {
@@ -133,165 +167,179 @@ void copy_buf_to_string(String *str, char *buf, size_t buf_size)
     da_append(str, '\0');
 }
 
-void lexer_set_only_token_type(enum TokenType type)
+static void lexer_set_lexeme(Lexer *lexer, int offset, int length)
 {
-    lexer.token.type = type;
-    lexer.token.lexeme.count = 0;
+    lexer->lexeme_offset = offset;
+    lexer->lexeme_length = length;
+
+    // the token array only keeps the slice
+    if(lexer->copy_lexemes) {
+        copy_buf_to_string(&lexer->token.lexeme, lexer->buf + offset, length);
+    }
 }
 
-bool lexer_is_first_token()
+static void lexer_set_only_token_type(Lexer *lexer, enum TokenType type)
 {
-    return lexer.token_count == 0;
+    lexer->token.type = type;
+    lexer->token.lexeme.count = 0;
+    lexer->lexeme_offset = lexer->cursor;
+    lexer->lexeme_length = 0;
 }
 
-bool lexer_is_prev_token(enum TokenType type)
+static bool lexer_is_first_token(Lexer *lexer)
 {
-    return lexer.prev_token.type == type;
+    return lexer->token_count == 0;
 }
 
-bool lexer_is_prev_token_whitespace()
+bool lexer_is_prev_token(Lexer *lexer, enum TokenType type)
 {
-    return lexer_is_prev_token(TKN_NEWLINE)
-            || lexer_is_first_token()
-            || lexer_is_prev_token(TKN_TAB);
+    return lexer->prev_token.type == type;
 }
 
-void lexer_process_next_token()
+static bool lexer_is_prev_token_whitespace(Lexer *lexer)
 {
-    char c = lexer_get_and_advance();
+    return lexer_is_prev_token(lexer, TKN_NEWLINE)
+            || lexer_is_first_token(lexer)
+            || lexer_is_prev_token(lexer, TKN_TAB);
+}
+
+static void lexer_process_next_token(Lexer *lexer)
+{
+    char c = lexer_get_and_advance(lexer);
 
     // TABS
-    if(c == ' ' && lexer_is_prev_token_whitespace()) {
+    if(c == ' ' && lexer_is_prev_token_whitespace(lexer)) {
         int spaces_count = 1;
 
-        while(lexer_is_next_char(' ') && spaces_count < 4) {
+        while(lexer_is_next_char(lexer, ' ') && spaces_count < 4) {
             spaces_count++;
-            c = lexer_get_and_advance();
+            c = lexer_get_and_advance(lexer);
         }
 
         if(spaces_count > 1) {
-            lexer_set_only_token_type(TKN_TAB);
+            lexer_set_only_token_type(lexer, TKN_TAB);
             return;
         }
 
         // if there's only 1 space, we ignore it, and continue lexing the next char
-        c = lexer_get_and_advance();
+        c = lexer_get_and_advance(lexer);
     }
 
     // HEADERS
-    if(c == '#' && lexer_is_prev_token_whitespace()) {
+    if(c == '#' && lexer_is_prev_token_whitespace(lexer)) {
         int level = 1;
 
-        while(lexer_peek_n_char(level - 1) == '#') level++;
+        while(lexer_peek_n_char(lexer, level - 1) == '#') level++;
 
-        if(lexer_peek_n_char(level - 1) == ' ') {
-            lexer.cursor += level;
-            lexer_set_only_token_type(get_header_type(level));
+        if(lexer_peek_n_char(lexer, level - 1) == ' ') {
+            lexer->cursor += level;
+            lexer_set_only_token_type(lexer, get_header_type(level));
             return;
         }
     }
 
     // NEWLINE
     if(c == '\n') {
-        lexer_set_only_token_type(TKN_NEWLINE);
+        lexer_set_only_token_type(lexer, TKN_NEWLINE);
         return;
     }
 
     // END OF FILE
     if(c == EOF) {
-        lexer_set_only_token_type(TKN_EOF);
+        lexer_set_only_token_type(lexer, TKN_EOF);
         return;
     }
 
     // UNORDERED LISTS
     // NOTE: It's important for this to be before of the bold & italic check
-    if(c == '*' && lexer_is_prev_token_whitespace()) {
-        if(lexer_is_next_char(' ')) {
-            lexer_advance(1);
-            lexer_set_only_token_type(TKN_ULIST_INDICATOR);
+    if(c == '*' && lexer_is_prev_token_whitespace(lexer)) {
+        if(lexer_is_next_char(lexer, ' ')) {
+            lexer_advance(lexer);
+            lexer_set_only_token_type(lexer, TKN_ULIST_INDICATOR);
             return;
         }
     }
 
     // ORDERED LISTS
-    if(isdigit(c) && lexer_is_prev_token_whitespace()) {
-        int start_pos = lexer.cursor - 1;
+    if(isdigit(c) && lexer_is_prev_token_whitespace(lexer)) {
+        int start_pos = lexer->cursor - 1;
         int digit_count = 1;
 
-        while(isdigit(lexer_peek_n_char(digit_count - 1))) digit_count++;
+        while(isdigit(lexer_peek_n_char(lexer, digit_count - 1))) digit_count++;
 
-        if(lexer_peek_n_char(digit_count - 1) == '.' && lexer_peek_n_char(digit_count) == ' ') {
-            lexer_advance_n(digit_count + 1);
+        if(lexer_peek_n_char(lexer, digit_count - 1) == '.' && lexer_peek_n_char(lexer, digit_count) == ' ') {
+            lexer_advance_n(lexer, digit_count + 1);
 
-            lexer.token.type = TKN_OLIST_INDICATOR;
-            copy_buf_to_string(&lexer.token.lexeme, lexer.buf + start_pos, lexer.cursor - start_pos);
+            lexer->token.type = TKN_OLIST_INDICATOR;
+            lexer_set_lexeme(lexer, start_pos, lexer->cursor - start_pos);
             return;
         }
     }
 
     // BOLD AND ITALIC
     if(c == '*' || c == '_') {
-        if((c == '*' && lexer_is_next_char('*')) || (c == '_' && lexer_is_next_char('_'))) {
-            lexer_advance();
+        if((c == '*' && lexer_is_next_char(lexer, '*')) || (c == '_' && lexer_is_next_char(lexer, '_'))) {
+            lexer_advance(lexer);
 
-            lexer_set_only_token_type(TKN_BOLD);
+            lexer_set_only_token_type(lexer, TKN_BOLD);
             return;
         }
 
-        lexer_set_only_token_type(TKN_ITALIC);
+        lexer_set_only_token_type(lexer, TKN_ITALIC);
         return;
     }
 
     // CODE BLOCKS
     // NOTE: this part should be before the inline code
-    if(c == '`' && lexer_is_prev_token_whitespace()) {
+    if(c == '`' && lexer_is_prev_token_whitespace(lexer)) {
         int tick_count = 1;
-        while(lexer_peek_n_char(tick_count - 1) == '`') tick_count++;
+        while(lexer_peek_n_char(lexer, tick_count - 1) == '`') tick_count++;
 
         if(tick_count >= 3) {
-            lexer_advance_n(tick_count - 1);
+            lexer_advance_n(lexer, tick_count - 1);
 
-            lexer.token.type = TKN_CODE_BLOCK;
-            lexer.token.lexeme.count = 0;
+            lexer->token.type = TKN_CODE_BLOCK;
+            int start_pos = lexer->cursor;
 
-            while((c = lexer_get_and_advance()) != EOF) {
-                if(c == '\n' && lexer_is_next_char('`')) {
+            while((c = lexer_get_and_advance(lexer)) != EOF) {
+                if(c == '\n' && lexer_is_next_char(lexer, '`')) {
                     int tick_count = 1;
-                    while(lexer_peek_n_char(tick_count - 1) == '`') tick_count++;
+                    while(lexer_peek_n_char(lexer, tick_count - 1) == '`') tick_count++;
 
 
                     if(tick_count >= 3) {
-                        lexer_advance_n(tick_count);
-                        da_append(&lexer.token.lexeme, '\0');
+                        // the newline before the closing ticks isn't part of the code
+                        lexer_set_lexeme(lexer, start_pos, lexer->cursor - 1 - start_pos);
+                        lexer_advance_n(lexer, tick_count);
                         return;
                     }
                 }
-
-                da_append(&lexer.token.lexeme, c);
             }
 
-            da_append(&lexer.token.lexeme, '\0');
+            int end_pos = lexer->cursor - 1;
+            if(end_pos > (int)lexer->buf_size) end_pos = lexer->buf_size;
+            lexer_set_lexeme(lexer, start_pos, end_pos - start_pos);
             return;
         }
     }
 
     // INLINE CODE
     if(c == '`') {
-        lexer.token.type = TKN_CODE;
+        lexer->token.type = TKN_CODE;
 
-        int start_pos = lexer.cursor;
+        int start_pos = lexer->cursor;
 
-        c = lexer_get_and_advance();
+        c = lexer_get_and_advance(lexer);
 
         while(c != '`' && c != '\n' && c != EOF) {
-            c = lexer_get_and_advance();
+            c = lexer_get_and_advance(lexer);
         }
 
-        copy_buf_to_string(&lexer.token.lexeme, lexer.buf + start_pos, lexer.cursor - start_pos - 1);
+        lexer_set_lexeme(lexer, start_pos, lexer->cursor - start_pos - 1);
 
         if(c != '`') {
             // we rewind either the \n or EOF
-            lexer_rewind(1);
+            lexer_rewind(lexer, 1);
         }
         return;
     }
@@ -299,116 +347,140 @@ void lexer_process_next_token()
     // LINKS
     // LINK TEXT
     if(c == '[') {
-        int char_count = 0;
-        int start_pos = lexer.cursor;
-
-        char next_char = lexer_peek_n_char(char_count);
-        while(next_char != ']' && next_char != '\n') {
-            char_count++;
-            next_char = lexer_peek_n_char(char_count);
-        }
+        int start_pos = lexer->cursor;
+        int end_pos = lexer_find_closing_char(lexer, ']');
 
-        if(next_char == ']') {
-            lexer_advance_n(char_count + 1);
-            lexer.token.type = TKN_LINK_TEXT;
-            int copy_size = lexer.cursor - start_pos - 1;
-            copy_buf_to_string(&lexer.token.lexeme, lexer.buf + start_pos, copy_size);
+        if(lexer_get_char(lexer, end_pos) == ']') {
+            lexer->cursor = end_pos + 1;
+            lexer->token.type = TKN_LINK_TEXT;
+            lexer_set_lexeme(lexer, start_pos, end_pos - start_pos);
             return;
         }
     }
     // LINK DESTINATION
-    if(c == '(' && lexer_is_prev_token(TKN_LINK_TEXT)) {
-        int char_count = 0;
-        int start_pos = lexer.cursor;
-
-        char next_char = lexer_peek_n_char(char_count);
-        while(next_char != ')' && next_char != '\n') {
-            char_count++;
-            next_char = lexer_peek_n_char(char_count);
-        }
-
-        if(next_char == ')') {
-            lexer_advance_n(char_count + 1);
-            lexer.token.type = TKN_LINK_DEST;
-            int copy_size = lexer.cursor - start_pos - 1;
-            copy_buf_to_string(&lexer.token.lexeme, lexer.buf + start_pos, copy_size);
+    if(c == '(' && lexer_is_prev_token(lexer, TKN_LINK_TEXT)) {
+        int start_pos = lexer->cursor;
+        int end_pos = lexer_find_closing_char(lexer, ')');
+
+        if(lexer_get_char(lexer, end_pos) == ')') {
+            lexer->cursor = end_pos + 1;
+            lexer->token.type = TKN_LINK_DEST;
+            lexer_set_lexeme(lexer, start_pos, end_pos - start_pos);
             return;
         }
     }
 
     // IMAGES
     // IMAGE ALT TEXT
-    if(c == '!' && lexer_is_next_char('[')) {
+    if(c == '!' && lexer_is_next_char(lexer, '[')) {
         // skip the '[' char
-        lexer_advance();
+        lexer_advance(lexer);
 
-        int char_count = 0;
-        int start_pos = lexer.cursor;
+        int start_pos = lexer->cursor;
+        int end_pos = lexer_find_closing_char(lexer, ']');
 
-        char next_char = lexer_peek_n_char(char_count);
-        while(next_char != ']' && next_char != '\n') {
-            char_count++;
-            next_char = lexer_peek_n_char(char_count);
-        }
-
-        if(next_char == ']') {
-            lexer_advance_n(char_count + 1);
-            lexer.token.type = TKN_IMAGE_ALT;
-            int copy_size = lexer.cursor - start_pos - 1;
-            copy_buf_to_string(&lexer.token.lexeme, lexer.buf + start_pos, copy_size);
+        if(lexer_get_char(lexer, end_pos) == ']') {
+            lexer->cursor = end_pos + 1;
+            lexer->token.type = TKN_IMAGE_ALT;
+            lexer_set_lexeme(lexer, start_pos, end_pos - start_pos);
             return;
         }
     }
     // IMAGE URL
-    if(c == '(' && lexer_is_prev_token(TKN_IMAGE_ALT)) {
-        int char_count = 0;
-        int start_pos = lexer.cursor;
-
-        char next_char = lexer_peek_n_char(char_count);
-        while(next_char != ')' && next_char != '\n') {
-            char_count++;
-            next_char = lexer_peek_n_char(char_count);
-        }
-
-        if(next_char == ')') {
-            lexer_advance_n(char_count + 1);
-            lexer.token.type = TKN_IMAGE_URL;
-            int copy_size = lexer.cursor - start_pos - 1;
-            copy_buf_to_string(&lexer.token.lexeme, lexer.buf + start_pos, copy_size);
+    if(c == '(' && lexer_is_prev_token(lexer, TKN_IMAGE_ALT)) {
+        int start_pos = lexer->cursor;
+        int end_pos = lexer_find_closing_char(lexer, ')');
+
+        if(lexer_get_char(lexer, end_pos) == ')') {
+            lexer->cursor = end_pos + 1;
+            lexer->token.type = TKN_IMAGE_URL;
+            lexer_set_lexeme(lexer, start_pos, end_pos - start_pos);
             return;
         }
     }
 
     // TEXT
-    int start_pos = lexer.cursor - 1;
+    int start_pos = lexer->cursor - 1;
 
-    c = lexer_get_and_advance();
+    c = lexer_get_and_advance(lexer);
     while(!is_special_char(c)) {
-        c = lexer_get_and_advance();
+        c = lexer_get_and_advance(lexer);
     }
 
     // we rewind the special character encountered
-    lexer_rewind(1);
+    lexer_rewind(lexer, 1);
 
-    lexer.token.type = TKN_TEXT;
-    copy_buf_to_string(&lexer.token.lexeme, lexer.buf + start_pos, lexer.cursor - start_pos);
+    lexer->token.type = TKN_TEXT;
+    lexer_set_lexeme(lexer, start_pos, lexer->cursor - start_pos);
 }
 
-Token *lexer_next_token()
+Token *lexer_next_token(Lexer *lexer)
 {
-    if(lexer.token_count > 0) {
-        lexer.prev_token.type = lexer.token.type;
+    if(lexer->token_count > 0) {
+        lexer->prev_token.type = lexer->token.type;
     }
-    lexer_process_next_token();
-    lexer.token_count++;
-    return &lexer.token;
+    lexer_process_next_token(lexer);
+    lexer->token_count++;
+    return &lexer->token;
 }
 
-void lexer_destroy()
+static void token_array_append(TokenArray *tokens, enum TokenType type, int offset, int length)
 {
-    if(lexer.buf != NULL)
-        free(lexer.buf);
+    if(tokens->count >= tokens->capacity) {
+        tokens->capacity = tokens->capacity == 0 ? DA_INIT_CAP : tokens->capacity * 2;
+        tokens->types = realloc(tokens->types, tokens->capacity * sizeof(*tokens->types));
+        tokens->offsets = realloc(tokens->offsets, tokens->capacity * sizeof(*tokens->offsets));
+        tokens->lengths = realloc(tokens->lengths, tokens->capacity * sizeof(*tokens->lengths));
+        assert(tokens->types != NULL && tokens->offsets != NULL && tokens->lengths != NULL && "No enough ram");
+    }
+
+    tokens->types[tokens->count] = type;
+    tokens->offsets[tokens->count] = offset;
+    tokens->lengths[tokens->count] = length;
+    tokens->count++;
+}
+
+bool lexer_tokenize(Lexer *lexer, TokenArray *tokens)
+{
+    if(lexer->buf_size > LEXER_MAX_SIZE) {
+        fprintf(stderr, "ERROR: The file is too big to be tokenized\n");
+        return false;
+    }
+
+    *tokens = (TokenArray){ .buf = lexer->buf };
+    lexer->copy_lexemes = false;
+
+    Token *token;
+    do {
+        token = lexer_next_token(lexer);
+        token_array_append(tokens, token->type, lexer->lexeme_offset, lexer->lexeme_length);
+    } while(token->type != TKN_EOF);
+
+    lexer->copy_lexemes = true;
+    return true;
+}
+
+char *token_array_dup_lexeme(const TokenArray *tokens, size_t i)
+{
+    return strndup(tokens->buf + tokens->offsets[i], tokens->lengths[i]);
+}
+
+void token_array_free(TokenArray *tokens)
+{
+    free(tokens->types);
+    free(tokens->offsets);
+    free(tokens->lengths);
+    *tokens = (TokenArray){0};
+}
+
+void lexer_destroy(Lexer *lexer)
+{
+    if(lexer->owns_buf)
+        free((char *)lexer->buf);
+
+    da_free(&lexer->token.lexeme);
+    da_free(&lexer->prev_token.lexeme);
 
-    da_free(&lexer.token.lexeme);
-    da_free(&lexer.prev_token.lexeme);
+    // so the lexer can be initialized again
+    *lexer = (Lexer){0};
 }
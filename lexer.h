@@ -2,8 +2,11 @@
 #define LEXER_H_
 
 #include <assert.h>
+#include <limits.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
 
 #define DA_INIT_CAP 256
 
@@ -56,17 +59,56 @@ typedef struct Token {
   String lexeme;
 } Token;
 
+// the result of the last scan for a closing char, a scan that starts between
+// start and end ends in the same place since there's no closing char nor
+// newline in between, this keeps lines full of unclosed brackets linear
+typedef struct LineScan {
+    int start;
+    int end;
+} LineScan;
+
+// the cursor and the lexemes of the lexer are ints, bigger buffers are rejected
+#define LEXER_MAX_SIZE INT_MAX
+
 typedef struct Lexer {
-    char *buf;
+    const char *buf;
+    bool owns_buf; // the buffer was loaded from a file by lexer_init
+    // computed once, long tokens like inline images would make it quadratic otherwise
+    size_t buf_size;
     int cursor;
     size_t token_count;
     Token prev_token;
     Token token;
+    LineScan bracket_scan; // ']' of the links and images
+    LineScan paren_scan; // ')' of their destinations
+    // the lexeme of the current token as a slice of the buffer, it's only
+    // copied to the token when lexing one token at a time
+    int lexeme_offset;
+    int lexeme_length;
+    bool copy_lexemes;
 } Lexer;
 
-bool lexer_init(const char *file_path);
-bool lexer_is_prev_token(enum TokenType type);
-Token *lexer_next_token();
-void lexer_destroy();
+// all the tokens of the buffer as parallel arrays, 9 bytes per token, the
+// lexemes are slices of the buffer so it has to outlive the array
+typedef struct TokenArray {
+    uint8_t *types;
+    uint32_t *offsets;
+    uint32_t *lengths;
+    size_t count;
+    size_t capacity;
+    const char *buf;
+} TokenArray;
+
+// every lexer is independent, so different files can be lexed in parallel
+bool lexer_init(Lexer *lexer, const char *file_path);
+// the buffer isn't copied, it has to outlive the lexer
+void lexer_init_buffer(Lexer *lexer, const char *buf, size_t size);
+bool lexer_is_prev_token(Lexer *lexer, enum TokenType type);
+Token *lexer_next_token(Lexer *lexer);
+// lexes the whole buffer at once, the last token is TKN_EOF
+bool lexer_tokenize(Lexer *lexer, TokenArray *tokens);
+char *token_array_dup_lexeme(const TokenArray *tokens, size_t i);
+void token_array_free(TokenArray *tokens);
+void lexer_destroy(Lexer *lexer);
 
 #endif
@@ -1,8 +1,21 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <string.h>
+#include <time.h>
 #include "raylib.h"
 #include "raymath.h"
 #include "lexer.h"
+#include "md_parser.h"
 #include "image.h"
+#include "stats.h"
+#include "telemetry.h"
+#include "decoder_process.h"
+#include "profiler.h"
+#include "trace.h"
+#include "scroll_bench.h"
+#include "html.h"
+#include "file_watcher.h"
 
 #define MD_BLACK CLITERAL(Color){9, 9, 17, 255}
 #define MD_BLACK_LIGHT CLITERAL(Color){20, 21, 31, 255}
@@ -31,6 +44,9 @@
 
 #define TAB_SIZE 20
 
+// time of a frame that can be spent swapping a reloaded document
+#define DOCUMENT_SWAP_BUDGET_MS 2
+
 enum MDNodeType {
     TEXT_NODE,
     ULIST_INDICATOR_NODE,
@@ -82,6 +98,66 @@ typedef struct MDList {
     size_t count;
 } MDList;
 
+// the first node of a heading, the hash of its text identifies it when the
+// document is reloaded
+typedef struct Heading {
+    MDNode *node;
+    uint64_t hash;
+} Heading;
+
+typedef struct Headings {
+    Heading *items;
+    size_t count;
+    size_t capacity;
+} Headings;
+
+typedef struct ImageNodes {
+    ImageNode **items;
+    size_t count;
+    size_t capacity;
+} ImageNodes;
+
+typedef struct Document {
+    MDList list;
+    // the image nodes, their urls are acquired by the render thread
+    ImageNodes images;
+    Headings headings; // in the order of the list
+} Document;
+
+// where the reader is, the last heading above the top of the screen
+typedef struct ScrollAnchor {
+    long heading; // index of the heading, -1 when there isn't one
+    float y; // position of the heading on the screen
+} ScrollAnchor;
+
+typedef struct Documents {
+    Document **items;
+    size_t count;
+    size_t capacity;
+} Documents;
+
+// the documents are double buffered, the watcher thread parses the next one
+// while the frames keep drawing the current one, and the render thread only
+// does the work that touches the image registry, a bit every frame
+typedef struct DocumentHandle {
+    const char *path; // where the documents are loaded from
+    // the last document parsed by the watcher thread, NULL once it's taken
+    _Atomic(Document *) published;
+    Document *current; // the one the frames draw
+    // the published document becomes the current one once its images are acquired
+    Document *incoming;
+    size_t incoming_acquired;
+    // the replaced documents, the render thread releases their images and
+    // then the reclaimer thread frees them
+    Documents retired;
+    size_t retired_released; // images released of the first one
+    pthread_t reclaimer;
+    pthread_mutex_t reclaim_lock;
+    pthread_cond_t reclaim_cond;
+    Documents reclaim; // guarded by the lock
+    bool reclaimer_running;
+} DocumentHandle;
+
 typedef struct Fonts {
     Font regular;
     Font bold;
@@ -93,6 +169,22 @@ typedef struct State {
     Fonts fonts;
 } State;
 
+typedef struct Options {
+    const char *file_path;
+    // where the image telemetry is written as json on exit, NULL to skip it
+    const char *telemetry_path;
+    // where the chrome trace of the run is written on exit, NULL to not record it
+    const char *trace_path;
+    // runs the scripted scroll without the frame cap and writes its results
+    // there, NULL to open the viewer normally
+    const char *bench_path;
+    // times the lexer and the parser without opening a window, and writes
+    // the results there
+    const char *parse_bench_path;
+    // converts the directory in the file path to html there, without opening a window
+    const char *html_output_dir;
+} Options;
+
 State state = {0};
 
 void insert_end_list_item(MDList *list, enum MDNodeType type, void *data)
@@ -121,173 +213,258 @@ void insert_end_list_item(MDList *list, enum MDNodeType type, void *data)
     list->count++;
 }
 
-int get_header_font_size(enum TokenType type)
+int get_header_font_size(int level)
 {
-    switch(type) {
-        case TKN_HEADER_1:
+    switch(level) {
+        case 1:
             return HEADER_1_FONT_SIZE;
-        case TKN_HEADER_2:
+        case 2:
             return HEADER_2_FONT_SIZE;
-        case TKN_HEADER_3:
+        case 3:
             return HEADER_3_FONT_SIZE;
-        case TKN_HEADER_4:
+        case 4:
             return HEADER_4_FONT_SIZE;
-        case TKN_HEADER_5:
+        case 5:
             return HEADER_5_FONT_SIZE;
-        case TKN_HEADER_6:
+        case 6:
             return HEADER_6_FONT_SIZE;
         default:
             return DEFAULT_FONT_SIZE;
     }
 }
 
-MDList get_parsed_markdown()
+// the md_parser callbacks build the list of nodes
+typedef struct ParseState {
+    Document doc;
+    int font_size; // of the current line
+    bool in_heading;
+} ParseState;
+
+#define HASH_BASIS 14695981039346656037ULL
+#define HASH_PRIME 1099511628211ULL
+
+// fnv-1a
+uint64_t hash_slice(uint64_t hash, MDSlice slice)
 {
-    MDList list = {0};
+    for(size_t i = 0; i < slice.size; i++) {
+        hash ^= (unsigned char)slice.data[i];
+        hash *= HASH_PRIME;
+    }
 
-    Token *token = lexer_next_token();
+    return hash;
+}
 
-    int font_size = DEFAULT_FONT_SIZE;
-    bool bold = false;
-    bool italic = false;
-    Color color = MD_WHITE;
+// the text of the headings is added to their hash, the first node of the
+// heading is the one inserted after it started
+void add_heading_text(ParseState *parse, MDSlice text)
+{
+    if(!parse->in_heading) return;
 
-    while(token->type != TKN_EOF) {
-        switch(token->type) {
-            case TKN_HEADER_1:
-            case TKN_HEADER_2:
-            case TKN_HEADER_3:
-            case TKN_HEADER_4:
-            case TKN_HEADER_5:
-            case TKN_HEADER_6: {
-                font_size = get_header_font_size(token->type);
-            } break;
-            case TKN_TEXT: {
-                TextNode *text = calloc(sizeof(TextNode), 1);
-
-                if(text == NULL) {
-                    TraceLog(LOG_ERROR, "Trying to allocate memory for a TextNode");
-                    break;
-                }
-
-                *text = (TextNode) {
-                    .font_size = font_size,
-                    .text = strdup(token->lexeme.items),
-                    .italic = italic,
-                    .bold = bold,
-                    .color = color,
-                };
-                insert_end_list_item(&list, TEXT_NODE, text);
-            } break;
-            case TKN_NEWLINE: {
-                // consecutive new lines should be ignored
-                if(lexer_is_prev_token(TKN_NEWLINE)) break;
+    Heading *heading = &parse->doc.headings.items[parse->doc.headings.count - 1];
+    if(heading->node == NULL) heading->node = parse->doc.list.tail;
+    heading->hash = hash_slice(heading->hash, text);
+}
 
-                NewLineNode *node = calloc(sizeof(NewLineNode), 1);
+char *slice_dup(MDSlice slice)
+{
+    return strndup(slice.data, slice.size);
+}
 
-                if(node == NULL) {
-                    TraceLog(LOG_ERROR, "Trying to allocate memory for a NewLineNode");
-                    break;
-                }
+void on_heading(void *user_data, int level)
+{
+    ParseState *parse = (ParseState*)user_data;
+    parse->font_size = get_header_font_size(level);
 
-                node->line_height = font_size;
-                insert_end_list_item(&list, NEWLINE_NODE, node);
+    parse->in_heading = true;
+    da_append(&parse->doc.headings, ((Heading){ .node = NULL, .hash = HASH_BASIS }));
+}
 
-                font_size = DEFAULT_FONT_SIZE;
-                italic = false;
-                bold = false;
-                color = MD_WHITE;
-            } break;
-            case TKN_ITALIC: {
-                italic = !italic;
-            } break;
-            case TKN_BOLD: {
-                bold = !bold;
-                color = bold ? MD_BLUE : MD_WHITE;
-            } break;
-            case TKN_CODE: {
-                TextNode *text = calloc(sizeof(TextNode), 1);
-
-                if(text == NULL) {
-                    TraceLog(LOG_ERROR, "Trying to allocate memory for a TextNode");
-                    break;
-                }
-
-                *text = (TextNode) {
-                    .font_size = font_size,
-                    .text = strdup(token->lexeme.items),
-                    .italic = italic,
-                    .bold = bold,
-                    .color = SKYBLUE,
-                };
-                insert_end_list_item(&list, TEXT_NODE, text);
-            } break;
-            case TKN_ULIST_INDICATOR: {
-                insert_end_list_item(&list, ULIST_INDICATOR_NODE, NULL);
-            } break;
-            case TKN_OLIST_INDICATOR: {
-                OListIndicatorNode *node = calloc(sizeof(OListIndicatorNode), 1);
+void on_text(void *user_data, MDTextStyle style, MDSlice text)
+{
+    ParseState *parse = (ParseState*)user_data;
+    TextNode *node = calloc(sizeof(TextNode), 1);
 
-                if(node == NULL) {
-                    TraceLog(LOG_ERROR, "Trying to allocate memory for a OListIndicatorNode");
-                    break;
-                }
+    if(node == NULL) {
+        TraceLog(LOG_ERROR, "Trying to allocate memory for a TextNode");
+        return;
+    }
 
-                node->indicator = strdup(token->lexeme.items);
-                insert_end_list_item(&list, OLIST_INDICATOR_NODE, node);
-            } break;
-            case TKN_TAB: {
-                insert_end_list_item(&list, TAB_NODE, NULL);
-            } break;
-            case TKN_LINK_TEXT: {
-                LinkNode *node = calloc(sizeof(LinkNode), 1);
-                node->text = strdup(token->lexeme.items);
-                insert_end_list_item(&list, LINK_NODE, node);
-            } break;
-            case TKN_LINK_DEST: {
-                MDNode *node = list.tail;
-                // TKN_LINK_TEXT should always appear before this token
-                // and therefore should create the necessary node
-                assert(node->type == LINK_NODE);
+    Color color = style.bold ? MD_BLUE : MD_WHITE;
+    if(style.code) color = SKYBLUE;
 
-                LinkNode *l_node = (LinkNode*)node->data;
-                l_node->dest = strdup(token->lexeme.items);
-            } break;
-            case TKN_IMAGE_ALT: {
-                ImageNode *node = calloc(sizeof(ImageNode), 1);
-                node->alt = strdup(token->lexeme.items);
-                insert_end_list_item(&list, IMAGE_NODE, node);
-            } break;
-            case TKN_IMAGE_URL: {
-                MDNode *node = list.tail;
-                // TKN_IMAGE_ALT should always appear before this token
-                // and therefore should create the necessary node
-                assert(node->type == IMAGE_NODE);
-                ImageNode *i_node = (ImageNode*)node->data;
+    *node = (TextNode) {
+        .font_size = parse->font_size,
+        .text = slice_dup(text),
+        .italic = style.italic,
+        .bold = style.bold,
+        .color = color,
+    };
+    insert_end_list_item(&parse->doc.list, TEXT_NODE, node);
+    add_heading_text(parse, text);
+}
 
-                i_node->url = strdup(token->lexeme.items);
-                i_node->loading_image = true;
+void on_newline(void *user_data)
+{
+    ParseState *parse = (ParseState*)user_data;
+    NewLineNode *node = calloc(sizeof(NewLineNode), 1);
 
-                image_loader_async_load(i_node);
-            } break;
-            case TKN_CODE_BLOCK: {
-                CodeBlockNode *c_node = calloc(sizeof(CodeBlockNode), 1);
+    if(node == NULL) {
+        TraceLog(LOG_ERROR, "Trying to allocate memory for a NewLineNode");
+        return;
+    }
 
-                if(c_node == NULL) {
-                    TraceLog(LOG_ERROR, "Trying to allocate memory for a CodeBlockNode");
-                    break;
-                }
+    node->line_height = parse->font_size;
+    insert_end_list_item(&parse->doc.list, NEWLINE_NODE, node);
 
-                c_node->contents = strdup(token->lexeme.items);
-                insert_end_list_item(&list, CODE_BLOCK_NODE, c_node);
-            } break;
-            case TKN_EOF: UNREACHABLE("END_OF_FILE reached");
+    // the headings without text can't be found again
+    Headings *headings = &parse->doc.headings;
+    if(parse->in_heading && headings->items[headings->count - 1].node == NULL) {
+        headings->count--;
+    }
+
+    parse->font_size = DEFAULT_FONT_SIZE;
+    parse->in_heading = false;
+}
+
+void on_list_item(void *user_data, bool ordered, MDSlice indicator)
+{
+    ParseState *parse = (ParseState*)user_data;
+
+    if(!ordered) {
+        insert_end_list_item(&parse->doc.list, ULIST_INDICATOR_NODE, NULL);
+        return;
+    }
+
+    OListIndicatorNode *node = calloc(sizeof(OListIndicatorNode), 1);
+
+    if(node == NULL) {
+        TraceLog(LOG_ERROR, "Trying to allocate memory for a OListIndicatorNode");
+        return;
+    }
+
+    node->indicator = slice_dup(indicator);
+    insert_end_list_item(&parse->doc.list, OLIST_INDICATOR_NODE, node);
+}
+
+void on_indent(void *user_data)
+{
+    ParseState *parse = (ParseState*)user_data;
+    insert_end_list_item(&parse->doc.list, TAB_NODE, NULL);
+}
+
+void on_link(void *user_data, MDSlice text, MDSlice dest)
+{
+    ParseState *parse = (ParseState*)user_data;
+    LinkNode *node = calloc(sizeof(LinkNode), 1);
+
+    if(node == NULL) {
+        TraceLog(LOG_ERROR, "Trying to allocate memory for a LinkNode");
+        return;
+    }
+
+    node->text = slice_dup(text);
+    if(dest.size > 0) node->dest = slice_dup(dest);
+    insert_end_list_item(&parse->doc.list, LINK_NODE, node);
+    add_heading_text(parse, text);
+}
+
+void on_image(void *user_data, MDSlice alt, MDSlice url)
+{
+    ParseState *parse = (ParseState*)user_data;
+    ImageNode *node = calloc(sizeof(ImageNode), 1);
+
+    if(node == NULL) {
+        TraceLog(LOG_ERROR, "Trying to allocate memory for a ImageNode");
+        return;
+    }
+
+    node->alt = slice_dup(alt);
+    if(url.size > 0) node->url = slice_dup(url);
+
+    insert_end_list_item(&parse->doc.list, IMAGE_NODE, node);
+    da_append(&parse->doc.images, node);
+}
+
+void on_code_block(void *user_data, MDSlice code)
+{
+    ParseState *parse = (ParseState*)user_data;
+    CodeBlockNode *node = calloc(sizeof(CodeBlockNode), 1);
+
+    if(node == NULL) {
+        TraceLog(LOG_ERROR, "Trying to allocate memory for a CodeBlockNode");
+        return;
+    }
+
+    node->contents = slice_dup(code);
+    insert_end_list_item(&parse->doc.list, CODE_BLOCK_NODE, node);
+}
+
+// it doesn't touch the image loader so it can run in any thread
+Document get_parsed_markdown(const TokenArray *tokens)
+{
+    static const MDCallbacks callbacks = {
+        .on_heading = on_heading,
+        .on_text = on_text,
+        .on_link = on_link,
+        .on_image = on_image,
+        .on_code_block = on_code_block,
+        .on_newline = on_newline,
+        .on_list_item = on_list_item,
+        .on_indent = on_indent,
+    };
+
+    ParseState parse = { .font_size = DEFAULT_FONT_SIZE };
+    md_parse_tokens(tokens, &callbacks, &parse);
+
+    return parse.doc;
+}
+
+double get_time_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+// the images are acquired and released in batches, the time is checked
+// after every batch
+#define IMAGES_BATCH_SIZE 64
+
+// only the render thread can do this, the images with the same url share the
+// same entry so the ones the previous document had are kept. It starts at the
+// index and stops at the deadline, returns the index where it stopped. The
+// urls are freed with the document, freeing thousands of small strings here
+// makes the next big allocation of the render thread consolidate them all
+// while the frame waits
+size_t acquire_document_images(Document *doc, size_t start, double deadline)
+{
+    size_t i = start;
+
+    while(i < doc->images.count) {
+        ImageNode *node = doc->images.items[i++];
+
+        if(node->url != NULL && node->entry == NULL) {
+            node->entry = image_loader_acquire(node->url);
         }
 
-        token = lexer_next_token();
+        if(i % IMAGES_BATCH_SIZE == 0 && get_time_ms() >= deadline) break;
+    }
+
+    return i;
+}
+
+// the same as acquiring them, once they're all released the document can be
+// freed by any thread
+size_t release_document_images(Document *doc, size_t start, double deadline)
+{
+    size_t i = start;
+
+    while(i < doc->images.count) {
+        release_image_node(doc->images.items[i++]);
+        if(i % IMAGES_BATCH_SIZE == 0 && get_time_ms() >= deadline) break;
     }
 
-    return list;
+    return i;
 }
 
 void free_md_list(MDList list)
@@ -332,6 +509,241 @@ void free_md_list(MDList list)
     }
 }
 
+// the images of the document have to be released by the render thread, unless
+// they were never acquired
+void free_document(Document *doc)
+{
+    free_md_list(doc->list);
+    da_free(&doc->images);
+    da_free(&doc->headings);
+    *doc = (Document){0};
+}
+
+bool load_document(const char *path, Document *doc)
+{
+    Lexer lexer;
+    trace_begin("lexer_init");
+    bool lexer_ready = lexer_init(&lexer, path);
+    trace_end();
+    if(!lexer_ready) {
+        return false;
+    }
+
+    trace_begin("lexer_tokenize");
+    TokenArray tokens = {0};
+    bool tokenized = lexer_tokenize(&lexer, &tokens);
+    trace_end();
+
+    if(tokenized) {
+        trace_begin("get_parsed_markdown");
+        *doc = get_parsed_markdown(&tokens);
+        trace_end();
+    }
+
+    token_array_free(&tokens);
+    lexer_destroy(&lexer);
+    return tokenized;
+}
+
+void free_document_ptr(Document *doc)
+{
+    free_document(doc);
+    free(doc);
+}
+
+// the documents are freed by this thread since freeing the nodes of a big one
+// takes longer than a frame
+void *reclaimer_worker(void *arg)
+{
+    DocumentHandle *handle = arg;
+    trace_set_thread_name("reclaimer");
+
+    pthread_mutex_lock(&handle->reclaim_lock);
+
+    while(true) {
+        while(handle->reclaim.count == 0 && handle->reclaimer_running) {
+            pthread_cond_wait(&handle->reclaim_cond, &handle->reclaim_lock);
+        }
+
+        if(handle->reclaim.count == 0) break;
+
+        Document *doc = handle->reclaim.items[--handle->reclaim.count];
+        pthread_mutex_unlock(&handle->reclaim_lock);
+
+        trace_begin("free_document");
+        free_document_ptr(doc);
+        trace_end();
+
+        pthread_mutex_lock(&handle->reclaim_lock);
+    }
+
+    pthread_mutex_unlock(&handle->reclaim_lock);
+    return NULL;
+}
+
+void document_handle_init(DocumentHandle *handle, const char *path, Document *doc)
+{
+    *handle = (DocumentHandle){ .path = path, .current = doc };
+    pthread_mutex_init(&handle->reclaim_lock, NULL);
+    pthread_cond_init(&handle->reclaim_cond, NULL);
+
+    handle->reclaimer_running = true;
+    if(pthread_create(&handle->reclaimer, NULL, reclaimer_worker, handle) != 0) {
+        TraceLog(LOG_WARNING, "Couldn't start the reclaimer thread, the documents will be freed by the render thread");
+        handle->reclaimer_running = false;
+    }
+}
+
+// can be called from any thread, a published document that wasn't taken yet
+// is replaced, its images were never acquired so it's freed right away
+void document_handle_publish(DocumentHandle *handle, Document *doc)
+{
+    Document *replaced = atomic_exchange(&handle->published, doc);
+    if(replaced != NULL) free_document_ptr(replaced);
+}
+
+// the document has no images acquired anymore
+void reclaim_document(DocumentHandle *handle, Document *doc)
+{
+    if(!handle->reclaimer_running) {
+        free_document_ptr(doc);
+        return;
+    }
+
+    pthread_mutex_lock(&handle->reclaim_lock);
+    da_append(&handle->reclaim, doc);
+    pthread_cond_signal(&handle->reclaim_cond);
+    pthread_mutex_unlock(&handle->reclaim_lock);
+}
+
+// called by the render thread at the start of every frame, it takes the
+// published document and does the work of the swap within a time budget, so
+// reloading a big document doesn't drop frames. Returns whether the current
+// document changed, the previous one is kept until the next frame
+bool document_handle_begin_frame(DocumentHandle *handle)
+{
+    double deadline = get_time_ms() + DOCUMENT_SWAP_BUDGET_MS;
+
+    // the documents retired in previous frames aren't used by any frame
+    while(handle->retired.count > 0) {
+        Document *doc = handle->retired.items[0];
+
+        trace_begin("release_images");
+        handle->retired_released = release_document_images(doc, handle->retired_released, deadline);
+        trace_end();
+        if(handle->retired_released < doc->images.count) break;
+
+        reclaim_document(handle, doc);
+        handle->retired.count--;
+        memmove(handle->retired.items, handle->retired.items + 1, handle->retired.count * sizeof(Document*));
+        handle->retired_released = 0;
+    }
+
+    Document *published = atomic_exchange(&handle->published, NULL);
+    if(published != NULL) {
+        // a newer one was parsed before the previous one got swapped in
+        if(handle->incoming != NULL) da_append(&handle->retired, handle->incoming);
+        handle->incoming = published;
+        handle->incoming_acquired = 0;
+    }
+
+    if(handle->incoming == NULL) return false;
+
+    // the new images are acquired before the old ones are released so the
+    // urls in both documents keep their textures
+    trace_begin("acquire_images");
+    handle->incoming_acquired = acquire_document_images(handle->incoming, handle->incoming_acquired, deadline);
+    trace_end();
+    if(handle->incoming_acquired < handle->incoming->images.count) return false;
+
+    da_append(&handle->retired, handle->current);
+    handle->current = handle->incoming;
+    handle->incoming = NULL;
+
+    TraceLog(LOG_INFO, "RELOAD: Document reloaded");
+    return true;
+}
+
+// the image loader has to be destroyed before since its workers keep
+// references to the image entries
+void document_handle_destroy(DocumentHandle *handle)
+{
+    if(handle->reclaimer_running) {
+        pthread_mutex_lock(&handle->reclaim_lock);
+        handle->reclaimer_running = false;
+        pthread_cond_signal(&handle->reclaim_cond);
+        pthread_mutex_unlock(&handle->reclaim_lock);
+        pthread_join(handle->reclaimer, NULL);
+    }
+    da_free(&handle->reclaim);
+
+    Document *published = atomic_exchange(&handle->published, NULL);
+    if(published != NULL) free_document_ptr(published);
+    if(handle->incoming != NULL) free_document_ptr(handle->incoming);
+
+    for(size_t i = 0; i < handle->retired.count; i++) {
+        free_document_ptr(handle->retired.items[i]);
+    }
+    da_free(&handle->retired);
+
+    free_document_ptr(handle->current);
+    pthread_mutex_destroy(&handle->reclaim_lock);
+    pthread_cond_destroy(&handle->reclaim_cond);
+}
+
+// called by the watcher thread, the current document keeps being drawn while
+// the new one is parsed
+void on_document_change(void *user_data)
+{
+    DocumentHandle *handle = user_data;
+
+    Document *doc = malloc(sizeof(Document));
+    if(doc == NULL) {
+        TraceLog(LOG_ERROR, "Trying to allocate memory for a Document");
+        return;
+    }
+
+    if(!load_document(handle->path, doc)) {
+        TraceLog(LOG_WARNING, "RELOAD: Couldn't parse %s, keeping the current document", handle->path);
+        free(doc);
+        return;
+    }
+
+    document_handle_publish(handle, doc);
+}
+
+// the heading of the new document with the same text, if there are several
+// the one with the same number of equal headings before it
+long find_matching_heading(const Document *old_doc, long index, const Document *new_doc)
+{
+    uint64_t hash = old_doc->headings.items[index].hash;
+    size_t occurrence = 0;
+
+    for(long i = 0; i < index; i++) {
+        if(old_doc->headings.items[i].hash == hash) occurrence++;
+    }
+
+    for(size_t i = 0; i < new_doc->headings.count; i++) {
+        if(new_doc->headings.items[i].hash != hash) continue;
+        if(occurrence == 0) return i;
+        occurrence--;
+    }
+
+    return -1;
+}
+
+// where the heading the reader was at has to be on the screen after the swap
+ScrollAnchor get_restore_anchor(const Document *old_doc, const Document *new_doc, ScrollAnchor anchor)
+{
+    ScrollAnchor restore = { .heading = -1 };
+    if(anchor.heading != -1) {
+        restore.heading = find_matching_heading(old_doc, anchor.heading, new_doc);
+        restore.y = anchor.y;
+    }
+
+    return restore;
+}
+
 void load_fonts()
 {
     int load_font_size = DEFAULT_FONT_SIZE;
@@ -362,7 +774,27 @@ Font get_font_from_text_node(TextNode *text)
     return state.fonts.regular;
 }
 
-Vector2 draw_text_node(Vector2 pos, int start_bound, int end_bound, TextNode *node)
+// every text measured and drawn goes through these so the profiler can count them
+Vector2 measure_text(Font font, const char *text, float font_size, float spacing)
+{
+    profiler_push(PHASE_MEASURE_TEXT);
+    profiler_count(COUNTER_MEASURE_TEXT);
+    Vector2 size = MeasureTextEx(font, text, font_size, spacing);
+    profiler_pop();
+
+    return size;
+}
+
+void draw_text(Font font, const char *text, Vector2 pos, float font_size, float spacing, Color color)
+{
+    profiler_push(PHASE_DRAW_TEXT);
+    profiler_count(COUNTER_DRAW_TEXT);
+    DrawTextEx(font, text, pos, font_size, spacing, color);
+    profiler_pop();
+}
+
+// the text is only measured when draw is false
+Vector2 layout_text_node(Vector2 pos, int start_bound, int end_bound, TextNode *node, bool draw)
 {
     Font font = get_font_from_text_node(node);
 
@@ -374,14 +806,14 @@ Vector2 draw_text_node(Vector2 pos, int start_bound, int end_bound, TextNode *no
     int space_size = node->font_size * 0.3;
 
     while((word = strsep(&str, " "))) {
-        Vector2 size = MeasureTextEx(font, word, node->font_size, spacing);
+        Vector2 size = measure_text(font, word, node->font_size, spacing);
 
         if(pos.x + size.x > end_bound) {
             pos.x = start_bound;
             pos.y += size.y + LINE_HEIGHT * node->font_size;
         }
 
-        DrawTextEx(font, word, pos, node->font_size, spacing, node->color);
+        if(draw) draw_text(font, word, pos, node->font_size, spacing, node->color);
         pos.x += size.x + space_size;
     }
 
@@ -413,9 +845,9 @@ void draw_list_indicator(Vector2 *pos, OListIndicatorNode *node)
     int spacing = 2;
     Font font = state.fonts.bold;
 
-    DrawTextEx(font, node->indicator, *pos, DEFAULT_FONT_SIZE, spacing, LIST_NUM_COLOR);
+    draw_text(font, node->indicator, *pos, DEFAULT_FONT_SIZE, spacing, LIST_NUM_COLOR);
 
-    Vector2 size = MeasureTextEx(font, node->indicator, DEFAULT_FONT_SIZE, spacing);
+    Vector2 size = measure_text(font, node->indicator, DEFAULT_FONT_SIZE, spacing);
     pos->x += size.x;
 }
 
@@ -440,7 +872,7 @@ void handle_link(Vector2 *pos, LinkNode *node)
 {
     int spacing = 2;
     Font font = state.fonts.regular;
-    Vector2 size = MeasureTextEx(font, node->text, DEFAULT_FONT_SIZE, spacing);
+    Vector2 size = measure_text(font, node->text, DEFAULT_FONT_SIZE, spacing);
 
     Vector2 mouse_pos = GetMousePosition();
     Rectangle link_boundary = {
@@ -469,7 +901,7 @@ void handle_link(Vector2 *pos, LinkNode *node)
 
     Color color = node->hover ? MD_BLUE : MD_WHITE;
     // draw link text
-    DrawTextEx(font, node->text, *pos, DEFAULT_FONT_SIZE, spacing, color);
+    draw_text(font, node->text, *pos, DEFAULT_FONT_SIZE, spacing, color);
 
     // draw line below text
     float line_pos_y = pos->y + size.y;
@@ -487,38 +919,246 @@ void handle_link(Vector2 *pos, LinkNode *node)
     pos->x += size.x;
 }
 
-int main(int argc, char **argv)
+// position of the heading from the top of the document, the nodes before it
+// are measured like the frame loop draws them, without drawing anything
+float layout_heading_y(const Document *doc, long heading, int screen_width)
+{
+    int line_height = 10;
+    int spacing = 2;
+    Vector2 pos = {0};
+    MDNode *heading_node = doc->headings.items[heading].node;
+
+    for(MDNode *node = doc->list.head; node != NULL && node != heading_node; node = node->next) {
+        switch(node->type) {
+            case TEXT_NODE: {
+                pos = layout_text_node(pos, 0, screen_width, (TextNode*)node->data, false);
+            } break;
+            case NEWLINE_NODE: {
+                pos.y += ((NewLineNode*)node->data)->line_height + line_height;
+                pos.x = 0;
+            } break;
+            case ULIST_INDICATOR_NODE: {
+                pos.x += LIST_MARGIN_LEFT + LIST_DOT_RADIUS * 2 + LIST_IND_MARGIN_RIGHT;
+            } break;
+            case OLIST_INDICATOR_NODE: {
+                OListIndicatorNode *o_node = (OListIndicatorNode*)node->data;
+                pos.x += LIST_MARGIN_LEFT + measure_text(state.fonts.bold, o_node->indicator, DEFAULT_FONT_SIZE, spacing).x;
+            } break;
+            case TAB_NODE: {
+                pos.x += TAB_SIZE;
+            } break;
+            case LINK_NODE: {
+                LinkNode *l_node = (LinkNode*)node->data;
+                pos.x += measure_text(state.fonts.regular, l_node->text, DEFAULT_FONT_SIZE, spacing).x;
+            } break;
+            case IMAGE_NODE: {
+                pos = Vector2Add(pos, measure_image_node(screen_width, (ImageNode*)node->data));
+            } break;
+            case CODE_BLOCK_NODE: {
+                CodeBlockNode *c_node = (CodeBlockNode*)node->data;
+                int padding = 20;
+                Vector2 text_size = measure_text(state.fonts.regular, c_node->contents, DEFAULT_FONT_SIZE, spacing);
+
+                pos.x += screen_width;
+                pos.y += text_size.y + padding * 2 - DEFAULT_FONT_SIZE;
+            } break;
+        }
+    }
+
+    return pos.y;
+}
+
+bool parse_options(int argc, char **argv, Options *options)
 {
-    if(argc < 2) {
+    for(int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+
+        if(strcmp(arg, "--telemetry") == 0) {
+            if(i + 1 >= argc) {
+                TraceLog(LOG_ERROR, "%s requires a file path", arg);
+                return false;
+            }
+            options->telemetry_path = argv[++i];
+        } else if(strcmp(arg, "--trace") == 0) {
+            if(i + 1 >= argc) {
+                TraceLog(LOG_ERROR, "%s requires a file path", arg);
+                return false;
+            }
+            options->trace_path = argv[++i];
+        } else if(strcmp(arg, "--bench-scroll") == 0) {
+            if(i + 1 >= argc) {
+                TraceLog(LOG_ERROR, "%s requires a file path, use - for stdout", arg);
+                return false;
+            }
+            options->bench_path = argv[++i];
+        } else if(strcmp(arg, "--bench-parse") == 0) {
+            if(i + 1 >= argc) {
+                TraceLog(LOG_ERROR, "%s requires a file path, use - for stdout", arg);
+                return false;
+            }
+            options->parse_bench_path = argv[++i];
+        } else if(strcmp(arg, "--to-html") == 0) {
+            if(i + 1 >= argc) {
+                TraceLog(LOG_ERROR, "%s requires an output directory", arg);
+                return false;
+            }
+            options->html_output_dir = argv[++i];
+        } else if(arg[0] == '-' && arg[1] != '\0') {
+            TraceLog(LOG_ERROR, "unknown option %s", arg);
+            return false;
+        } else if(options->file_path == NULL) {
+            options->file_path = arg;
+        } else {
+            TraceLog(LOG_ERROR, "too many arguments");
+            return false;
+        }
+    }
+
+    if(options->file_path == NULL) {
         TraceLog(LOG_ERROR, "file path is required");
+        return false;
+    }
+
+    return true;
+}
+
+bool run_parse_bench(const char *file_path, const char *results_path)
+{
+    Lexer lexer;
+    double start = get_time_ms();
+    if(!lexer_init(&lexer, file_path)) return false;
+    double read_time = get_time_ms() - start;
+
+    size_t bytes = GetFileLength(file_path);
+    TokenArray tokens = {0};
+
+    start = get_time_ms();
+    bool tokenized = lexer_tokenize(&lexer, &tokens);
+    double lex_time = get_time_ms() - start;
+
+    if(!tokenized) {
+        lexer_destroy(&lexer);
+        return false;
+    }
+
+    // the loader isn't started, the images are acquired by the render thread
+    // once the document is shown, so they aren't part of the parsing
+    start = get_time_ms();
+    Document doc = get_parsed_markdown(&tokens);
+    double parse_time = get_time_ms() - start;
+
+    size_t tokens_count = tokens.count;
+    size_t tokens_memory = tokens.capacity * (sizeof(*tokens.types) + sizeof(*tokens.offsets) + sizeof(*tokens.lengths));
+    token_array_free(&tokens);
+    lexer_destroy(&lexer);
+
+    size_t nodes_count = 0;
+    for(MDNode *node = doc.list.head; node != NULL; node = node->next) nodes_count++;
+
+    free_document(&doc);
+
+    bool to_stdout = strcmp(results_path, "-") == 0;
+    FILE *file = to_stdout ? stdout : fopen(results_path, "w");
+
+    if(file == NULL) {
+        TraceLog(LOG_ERROR, "Couldn't open file %s: %s", results_path, strerror(errno));
+        return false;
+    }
+
+    double megabytes = bytes / (1024.0 * 1024.0);
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"bytes\": %zu,\n", bytes);
+    fprintf(file, "  \"tokens\": %zu,\n", tokens_count);
+    fprintf(file, "  \"tokens_bytes\": %zu,\n", tokens_memory);
+    fprintf(file, "  \"nodes\": %zu,\n", nodes_count);
+    fprintf(file, "  \"read_ms\": %.3f,\n", read_time);
+    fprintf(file, "  \"lex_ms\": %.3f,\n", lex_time);
+    fprintf(file, "  \"parse_ms\": %.3f,\n", parse_time);
+    fprintf(file, "  \"lex_mb_s\": %.3f,\n", megabytes / (lex_time / 1000));
+    fprintf(file, "  \"parse_mb_s\": %.3f,\n", megabytes / (parse_time / 1000));
+    fprintf(file, "  \"peak_rss_kb\": %ld\n", get_peak_rss_kb());
+    fprintf(file, "}\n");
+
+    if(!to_stdout) fclose(file);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    // the image loader starts this same program to decode the images in
+    // separate processes
+    if(argc > 1 && strcmp(argv[1], DECODER_PROCESS_ARG) == 0) {
+        return decoder_process_main(argc, argv);
+    }
+
+    Options options = {0};
+    if(!parse_options(argc, argv, &options)) {
         return -1;
-    } else if(argc > 2) {
-        TraceLog(LOG_ERROR, "too many arguments");
-        return -1;
     }
 
-    const char *file_path = argv[1];
-    if(!lexer_init(file_path)) {
+    if(options.parse_bench_path != NULL) {
+        return run_parse_bench(options.file_path, options.parse_bench_path) ? 0 : -1;
+    }
+
+    if(options.html_output_dir != NULL) {
+        return html_convert_directory(options.file_path, options.html_output_dir) ? 0 : -1;
+    }
+
+    if(options.trace_path != NULL) {
+        trace_start();
+        trace_set_thread_name("main");
+    }
+
+    const char *file_path = options.file_path;
+    Document *first_doc = malloc(sizeof(Document));
+    if(first_doc == NULL || !load_document(file_path, first_doc)) {
+        free(first_doc);
         return -1;
     }
 
     InitWindow(1280, 720, "Markdown RayDer");
-    SetTargetFPS(60);
+    if(options.bench_path == NULL) {
+        SetTargetFPS(60);
+    }
 
-    image_loader_init();
-    MDList list = get_parsed_markdown();
-    lexer_destroy();
+    image_loader_init(file_path);
+    acquire_document_images(first_doc, 0, INFINITY);
+
+    DocumentHandle handle;
+    document_handle_init(&handle, file_path, first_doc);
+
+    // the document is reloaded when it's saved, the benchmark has to draw
+    // always the same one
+    FileWatcher watcher;
+    bool watching = options.bench_path == NULL &&
+                    file_watcher_start(&watcher, file_path, on_document_change, &handle);
+
+    trace_begin("load_fonts");
     load_fonts();
+    trace_end();
 
     Vector2 camera_pos = {0};
+    Samples frame_times = {0};
+    ScrollBench bench = {0};
+    float document_height = 0;
+    ScrollAnchor anchor = { .heading = -1 };
 
     while(!WindowShouldClose()) {
+        profiler_begin_frame();
+        trace_begin("frame");
+        profiler_push(PHASE_INPUT);
+
         int screen_width = GetScreenWidth();
+        int screen_height = GetScreenHeight();
         int scroll_speed = 1000;
 
         float dt = GetFrameTime();
+        samples_push_window(&frame_times, dt * 1000, FRAME_TIMES_WINDOW);
 
-        if(IsKeyDown(KEY_DOWN) || IsKeyDown(KEY_J)) {
+        if(options.bench_path != NULL) {
+            if(!scroll_bench_step(&bench, &camera_pos, document_height, screen_height)) break;
+        } else if(IsKeyDown(KEY_DOWN) || IsKeyDown(KEY_J)) {
             camera_pos.y -= scroll_speed * dt;
         } else if(IsKeyDown(KEY_UP) || IsKeyDown(KEY_K)) {
             camera_pos.y += scroll_speed * dt;
@@ -538,18 +1178,58 @@ int main(int argc, char **argv)
             ToggleFullscreen();
         }
 
+        if(IsKeyPressed(KEY_F3)) {
+            profiler_toggle_overlay();
+        }
+
+        profiler_pop();
+
+        profiler_push(PHASE_IMAGES);
+        // the frame draws the same document from start to end
+        Document *previous = handle.current;
+        if(document_handle_begin_frame(&handle)) {
+            // the heading the reader was at stays in the same place, it's
+            // measured before drawing so the first frame is already there
+            ScrollAnchor restore = get_restore_anchor(previous, handle.current, anchor);
+            if(restore.heading != -1) {
+                trace_begin("restore_scroll");
+                camera_pos.y = restore.y - layout_heading_y(handle.current, restore.heading, screen_width);
+                if(camera_pos.y > 0) camera_pos.y = 0;
+                trace_end();
+            }
+
+            // the link under the mouse may be gone
+            SetMouseCursor(MOUSE_CURSOR_DEFAULT);
+        }
+        Document *doc = handle.current;
+
+        image_loader_begin_frame(screen_width);
+        profiler_pop();
+
+        profiler_push(PHASE_LAYOUT);
+
         BeginDrawing();
         ClearBackground(MD_BLACK);
 
         int line_height = 10;
         Vector2 draw_pos = camera_pos;
-        MDNode *node = list.head;
+        MDNode *node = doc->list.head;
+        size_t next_heading = 0;
+        anchor.heading = -1;
 
         while(node != NULL) {
+            profiler_count(COUNTER_NODES_VISITED);
+            float start_y = draw_pos.y;
+
+            if(next_heading < doc->headings.count && doc->headings.items[next_heading].node == node) {
+                if(start_y <= 0) anchor = (ScrollAnchor){ next_heading, start_y };
+                next_heading++;
+            }
+
             switch(node->type) {
                 case TEXT_NODE: {
                     TextNode *text_node = (TextNode*)node->data;
-                    draw_pos = draw_text_node(draw_pos, 0, screen_width, text_node);
+                    draw_pos = layout_text_node(draw_pos, 0, screen_width, text_node, true);
                 } break;
                 case NEWLINE_NODE: {
                     NewLineNode *n_node = (NewLineNode*)node->data;
@@ -570,7 +1250,9 @@ int main(int argc, char **argv)
                 } break;
                 case IMAGE_NODE: {
                     ImageNode *i_node = (ImageNode*)node->data;
+                    profiler_push(PHASE_IMAGES);
                     Vector2 image_size = draw_image_node(draw_pos, screen_width, i_node);
+                    profiler_pop();
                     draw_pos = Vector2Add(draw_pos, image_size);
                 } break;
                 case CODE_BLOCK_NODE: {
@@ -580,7 +1262,7 @@ int main(int argc, char **argv)
                     Font font = state.fonts.regular;
                     int padding = 20;
 
-                    Vector2 text_size = MeasureTextEx(font, c_node->contents, DEFAULT_FONT_SIZE, spacing);
+                    Vector2 text_size = measure_text(font, c_node->contents, DEFAULT_FONT_SIZE, spacing);
                     DrawRectangle(0, draw_pos.y, screen_width, text_size.y + padding * 2, MD_BLACK_LIGHT);
 
                     Vector2 text_pos = {
@@ -588,24 +1270,62 @@ int main(int argc, char **argv)
                         draw_pos.y + padding,
                     };
 
-                    DrawTextEx(font, c_node->contents, text_pos, DEFAULT_FONT_SIZE, spacing, MD_WHITE);
+                    draw_text(font, c_node->contents, text_pos, DEFAULT_FONT_SIZE, spacing, MD_WHITE);
 
                     draw_pos.x += screen_width;
                     draw_pos.y += text_size.y + padding * 2 - DEFAULT_FONT_SIZE;
                 } break;
             }
 
+            // newlines and tabs only move the position
+            bool visible = node->type != NEWLINE_NODE && node->type != TAB_NODE;
+            if(visible && start_y < screen_height && draw_pos.y + DEFAULT_FONT_SIZE > 0) {
+                profiler_count(COUNTER_NODES_DRAWN);
+            }
+
             node = node->next;
         }
 
+        document_height = draw_pos.y - camera_pos.y;
+
+        profiler_pop();
+
+        profiler_draw_overlay(screen_width);
+
+        profiler_push(PHASE_PRESENT);
         EndDrawing();
+        profiler_pop();
+        trace_end();
+    }
+
+    log_frame_times(&frame_times);
+    da_free(&frame_times);
+
+    if(options.bench_path != NULL) {
+        scroll_bench_write_json(&bench, options.bench_path);
+        scroll_bench_destroy(&bench);
+    }
+
+    if(watching) file_watcher_stop(&watcher);
+
+    telemetry_log();
+    if(options.telemetry_path != NULL) {
+        telemetry_write_json(options.telemetry_path);
     }
 
+    // the loader has to be stopped before freeing the documents since its
+    // workers keep references to the image entries
+    image_loader_destroy();
+
     unload_fonts();
-    free_md_list(list);
+    document_handle_destroy(&handle);
     CloseWindow();
 
-    image_loader_destroy();
+    // written at the end since the loader threads have to be stopped
+    if(options.trace_path != NULL) {
+        trace_write_json(options.trace_path);
+        trace_destroy();
+    }
 
     return 0;
 }
@@ -0,0 +1,144 @@
+#include <string.h>
+
+#include "md_parser.h"
+
+typedef struct Parser {
+    const MDCallbacks *callbacks;
+    void *user_data;
+    MDTextStyle style;
+    enum TokenType prev_type;
+    bool first_token;
+    // links and images are reported once we know whether their destination follows
+    enum TokenType pending_type;
+    MDSlice pending;
+} Parser;
+
+static void flush_pending(Parser *parser, MDSlice dest)
+{
+    const MDCallbacks *callbacks = parser->callbacks;
+
+    if(parser->pending_type == TKN_LINK_TEXT && callbacks->on_link) {
+        callbacks->on_link(parser->user_data, parser->pending, dest);
+    } else if(parser->pending_type == TKN_IMAGE_ALT && callbacks->on_image) {
+        callbacks->on_image(parser->user_data, parser->pending, dest);
+    }
+
+    parser->pending_type = TKN_EOF;
+}
+
+static void parser_feed(Parser *parser, enum TokenType type, MDSlice lexeme)
+{
+    const MDCallbacks *callbacks = parser->callbacks;
+    void *user_data = parser->user_data;
+
+    bool is_dest = (type == TKN_LINK_DEST && parser->pending_type == TKN_LINK_TEXT)
+                   || (type == TKN_IMAGE_URL && parser->pending_type == TKN_IMAGE_ALT);
+    if(is_dest) {
+        flush_pending(parser, lexeme);
+        parser->prev_type = type;
+        return;
+    }
+
+    if(parser->pending_type != TKN_EOF) flush_pending(parser, (MDSlice){ lexeme.data, 0 });
+
+    switch(type) {
+        case TKN_HEADER_1:
+        case TKN_HEADER_2:
+        case TKN_HEADER_3:
+        case TKN_HEADER_4:
+        case TKN_HEADER_5:
+        case TKN_HEADER_6: {
+            parser->style.heading_level = type - TKN_HEADER_1 + 1;
+            if(callbacks->on_heading) callbacks->on_heading(user_data, parser->style.heading_level);
+        } break;
+        case TKN_TEXT:
+        case TKN_CODE: {
+            MDTextStyle style = parser->style;
+            style.code = type == TKN_CODE;
+            if(callbacks->on_text) callbacks->on_text(user_data, style, lexeme);
+        } break;
+        case TKN_NEWLINE: {
+            // consecutive new lines should be ignored
+            if(!parser->first_token && parser->prev_type == TKN_NEWLINE) break;
+
+            if(callbacks->on_newline) callbacks->on_newline(user_data);
+            parser->style = (MDTextStyle){0};
+        } break;
+        case TKN_ITALIC: {
+            parser->style.italic = !parser->style.italic;
+        } break;
+        case TKN_BOLD: {
+            parser->style.bold = !parser->style.bold;
+        } break;
+        case TKN_ULIST_INDICATOR: {
+            if(callbacks->on_list_item) callbacks->on_list_item(user_data, false, (MDSlice){ lexeme.data, 0 });
+        } break;
+        case TKN_OLIST_INDICATOR: {
+            if(callbacks->on_list_item) callbacks->on_list_item(user_data, true, lexeme);
+        } break;
+        case TKN_TAB: {
+            if(callbacks->on_indent) callbacks->on_indent(user_data);
+        } break;
+        case TKN_LINK_TEXT:
+        case TKN_IMAGE_ALT: {
+            parser->pending_type = type;
+            parser->pending = lexeme;
+        } break;
+        case TKN_CODE_BLOCK: {
+            if(callbacks->on_code_block) callbacks->on_code_block(user_data, lexeme);
+        } break;
+        // a destination without its text is ignored
+        case TKN_LINK_DEST:
+        case TKN_IMAGE_URL:
+        case TKN_EOF: break;
+    }
+
+    parser->prev_type = type;
+    parser->first_token = false;
+}
+
+static void parser_init(Parser *parser, const MDCallbacks *callbacks, void *user_data)
+{
+    *parser = (Parser){
+        .callbacks = callbacks,
+        .user_data = user_data,
+        .first_token = true,
+        .pending_type = TKN_EOF,
+    };
+}
+
+void md_parse(const char *buf, size_t size, const MDCallbacks *callbacks, void *user_data)
+{
+    if(size > LEXER_MAX_SIZE) {
+        fprintf(stderr, "ERROR: The buffer is too big to be parsed\n");
+        return;
+    }
+
+    Lexer lexer;
+    lexer_init_buffer(&lexer, buf, size);
+    // the lexemes are read from the buffer, so the lexer doesn't copy them
+    lexer.copy_lexemes = false;
+
+    Parser parser;
+    parser_init(&parser, callbacks, user_data);
+
+    Token *token;
+    do {
+        token = lexer_next_token(&lexer);
+        MDSlice lexeme = { buf + lexer.lexeme_offset, lexer.lexeme_length };
+        parser_feed(&parser, token->type, lexeme);
+    } while(token->type != TKN_EOF);
+
+    lexer_destroy(&lexer);
+}
+
+void md_parse_tokens(const TokenArray *tokens, const MDCallbacks *callbacks, void *user_data)
+{
+    Parser parser;
+    parser_init(&parser, callbacks, user_data);
+
+    for(size_t i = 0; i < tokens->count; i++) {
+        MDSlice lexeme = { tokens->buf + tokens->offsets[i], tokens->lengths[i] };
+        parser_feed(&parser, tokens->types[i], lexeme);
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef MD_PARSER_H_
+#define MD_PARSER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "lexer.h"
+
+// part of the parsed buffer, it isn't null terminated
+typedef struct MDSlice {
+    const char *data;
+    size_t size;
+} MDSlice;
+
+typedef struct MDTextStyle {
+    int heading_level; // 0 outside of the headings
+    bool bold;
+    bool italic;
+    bool code; // inline code
+} MDTextStyle;
+
+// the parser calls these while it reads the document, any of them can be
+// NULL, the slices point into the parsed buffer so nothing is allocated
+typedef struct MDCallbacks {
+    // the text after it until the next newline is part of the heading
+    void (*on_heading)(void *user_data, int level);
+    void (*on_text)(void *user_data, MDTextStyle style, MDSlice text);
+    // the destination is empty when the link doesn't have one
+    void (*on_link)(void *user_data, MDSlice text, MDSlice dest);
+    void (*on_image)(void *user_data, MDSlice alt, MDSlice url);
+    void (*on_code_block)(void *user_data, MDSlice code);
+    // consecutive newlines are reported once, the style of the line ends there
+    void (*on_newline)(void *user_data);
+    // the indicator is the number of the ordered lists, it's empty for the unordered ones
+    void (*on_list_item)(void *user_data, bool ordered, MDSlice indicator);
+    void (*on_indent)(void *user_data);
+} MDCallbacks;
+
+// lexes and parses the buffer in one pass, buffers bigger than
+// LEXER_MAX_SIZE are rejected without calling any callback
+void md_parse(const char *buf, size_t size, const MDCallbacks *callbacks, void *user_data);
+// parses a document that was already tokenized
+void md_parse_tokens(const TokenArray *tokens, const MDCallbacks *callbacks, void *user_data);
+
+#endif
@@ -0,0 +1,48 @@
+#include "mpsc_queue.h"
+
+void mpsc_queue_init(MPSCQueue *queue)
+{
+    atomic_store_explicit(&queue->stub.next, NULL, memory_order_relaxed);
+    atomic_store_explicit(&queue->head, &queue->stub, memory_order_relaxed);
+    queue->tail = &queue->stub;
+}
+
+void mpsc_queue_push(MPSCQueue *queue, MPSCNode *node)
+{
+    atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+    MPSCNode *prev = atomic_exchange_explicit(&queue->head, node, memory_order_acq_rel);
+    atomic_store_explicit(&prev->next, node, memory_order_release);
+}
+
+MPSCNode *mpsc_queue_pop(MPSCQueue *queue)
+{
+    MPSCNode *tail = queue->tail;
+    MPSCNode *next = atomic_load_explicit(&tail->next, memory_order_acquire);
+
+    if(tail == &queue->stub) {
+        if(next == NULL) return NULL;
+
+        queue->tail = next;
+        tail = next;
+        next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    }
+
+    if(next != NULL) {
+        queue->tail = next;
+        return tail;
+    }
+
+    // the tail is the last node, we push the stub back so we can pop it
+    MPSCNode *head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    if(tail != head) return NULL;
+
+    mpsc_queue_push(queue, &queue->stub);
+
+    next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    if(next != NULL) {
+        queue->tail = next;
+        return tail;
+    }
+
+    return NULL;
+}
@@ -0,0 +1,29 @@
+#ifndef MPSC_QUEUE_H_
+#define MPSC_QUEUE_H_
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+// intrusive multiple-producer single-consumer queue (Dmitry Vyukov's design),
+// pushing never blocks and popping is only done from one thread
+typedef struct MPSCNode MPSCNode;
+
+struct MPSCNode {
+    _Atomic(MPSCNode *) next;
+};
+
+typedef struct MPSCQueue {
+    _Atomic(MPSCNode *) head;
+    MPSCNode *tail;
+    MPSCNode stub;
+} MPSCQueue;
+
+#define mpsc_container_of(ptr, type, member) ((type *)((char *)(ptr) - offsetof(type, member)))
+
+void mpsc_queue_init(MPSCQueue *queue);
+void mpsc_queue_push(MPSCQueue *queue, MPSCNode *node);
+// returns NULL when the queue is empty, or when a producer is in the middle of
+// a push, in that case the item shows up in a later call
+MPSCNode *mpsc_queue_pop(MPSCQueue *queue);
+
+#endif
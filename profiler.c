@@ -0,0 +1,277 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "raylib.h"
+#include "profiler.h"
+#include "stats.h"
+#include "trace.h"
+
+#define PROFILER_MAX_DEPTH 8
+#define OVERLAY_MARGIN 10
+#define OVERLAY_PADDING 10
+#define OVERLAY_FONT_SIZE 10
+#define OVERLAY_LINE_HEIGHT 14
+#define OVERLAY_GRAPH_HEIGHT 100
+// time that fills the whole height of the graph
+#define OVERLAY_GRAPH_MAX_MS 33.3f
+#define OVERLAY_BG CLITERAL(Color){0, 0, 0, 200}
+
+typedef struct ProfilerFrame {
+    float phases[PHASES_COUNT]; // in milliseconds
+    float total;
+    size_t counters[COUNTERS_COUNT];
+} ProfilerFrame;
+
+typedef struct Profiler {
+    ProfilerFrame frames[PROFILER_FRAMES];
+    size_t frames_count;
+    size_t next_frame;
+
+    // the frame being recorded
+    ProfilerFrame current;
+    double frame_start;
+    size_t frame_allocations;
+
+    enum ProfilerPhase stack[PROFILER_MAX_DEPTH];
+    size_t depth;
+    // pushes past the maximum depth, their pops must not pop an outer phase
+    size_t overflow;
+    double last_switch;
+
+    bool overlay_visible;
+} Profiler;
+
+static const char *phase_names[PHASES_COUNT] = {
+    [PHASE_INPUT] = "input",
+    [PHASE_LAYOUT] = "layout",
+    [PHASE_MEASURE_TEXT] = "measure text",
+    [PHASE_DRAW_TEXT] = "draw text",
+    [PHASE_IMAGES] = "images",
+    [PHASE_PRESENT] = "present",
+};
+
+// text is measured and drawn once per word, those would bloat the trace
+static const bool phase_traced[PHASES_COUNT] = {
+    [PHASE_INPUT] = true,
+    [PHASE_LAYOUT] = true,
+    [PHASE_IMAGES] = true,
+    [PHASE_PRESENT] = true,
+};
+
+static const Color phase_colors[PHASES_COUNT] = {
+    [PHASE_INPUT] = GRAY,
+    [PHASE_LAYOUT] = SKYBLUE,
+    [PHASE_MEASURE_TEXT] = ORANGE,
+    [PHASE_DRAW_TEXT] = GOLD,
+    [PHASE_IMAGES] = LIME,
+    [PHASE_PRESENT] = VIOLET,
+};
+
+static const char *counter_names[COUNTERS_COUNT] = {
+    [COUNTER_NODES_VISITED] = "nodes visited",
+    [COUNTER_NODES_DRAWN] = "nodes drawn",
+    [COUNTER_MEASURE_TEXT] = "MeasureTextEx",
+    [COUNTER_DRAW_TEXT] = "DrawTextEx",
+    [COUNTER_ALLOCATIONS] = "allocations",
+};
+
+static Profiler profiler = {0};
+
+// build.sh links with --wrap for these functions, so every allocation of
+// the program goes through here, the counter is per thread since we only
+// care about the ones of the render thread
+static _Thread_local size_t allocations = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+char *__real_strdup(const char *str);
+char *__real_strndup(const char *str, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+    allocations++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+    allocations++;
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    allocations++;
+    return __real_realloc(ptr, size);
+}
+
+// the allocations libc does internally aren't wrapped, so the ones we call
+// directly are counted here
+char *__wrap_strdup(const char *str)
+{
+    allocations++;
+    return __real_strdup(str);
+}
+
+char *__wrap_strndup(const char *str, size_t size)
+{
+    allocations++;
+    return __real_strndup(str, size);
+}
+
+static double get_time_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+void profiler_begin_frame()
+{
+    double now = get_time_ms();
+
+    if(profiler.frame_start > 0) {
+        profiler.current.total = now - profiler.frame_start;
+        profiler.current.counters[COUNTER_ALLOCATIONS] = allocations - profiler.frame_allocations;
+
+        profiler.frames[profiler.next_frame] = profiler.current;
+        profiler.next_frame = (profiler.next_frame + 1) % PROFILER_FRAMES;
+        if(profiler.frames_count < PROFILER_FRAMES) profiler.frames_count++;
+    }
+
+    profiler.current = (ProfilerFrame){0};
+    profiler.frame_start = now;
+    profiler.frame_allocations = allocations;
+    profiler.depth = 0;
+    profiler.overflow = 0;
+}
+
+void profiler_push(enum ProfilerPhase phase)
+{
+    double now = get_time_ms();
+
+    if(profiler.depth > 0) {
+        profiler.current.phases[profiler.stack[profiler.depth - 1]] += now - profiler.last_switch;
+    }
+
+    profiler.last_switch = now;
+
+    if(profiler.depth == PROFILER_MAX_DEPTH) {
+        profiler.overflow++;
+        return;
+    }
+
+    profiler.stack[profiler.depth++] = phase;
+    if(phase_traced[phase]) trace_begin(phase_names[phase]);
+}
+
+void profiler_pop()
+{
+    if(profiler.overflow > 0) {
+        profiler.overflow--;
+        return;
+    }
+
+    if(profiler.depth == 0) return;
+
+    double now = get_time_ms();
+    enum ProfilerPhase phase = profiler.stack[--profiler.depth];
+    profiler.current.phases[phase] += now - profiler.last_switch;
+    profiler.last_switch = now;
+
+    if(phase_traced[phase]) trace_end();
+}
+
+void profiler_count(enum ProfilerCounter counter)
+{
+    profiler.current.counters[counter]++;
+}
+
+void profiler_toggle_overlay()
+{
+    profiler.overlay_visible = !profiler.overlay_visible;
+}
+
+static const ProfilerFrame *get_frame(size_t age)
+{
+    size_t index = (profiler.next_frame + PROFILER_FRAMES - 1 - age) % PROFILER_FRAMES;
+    return &profiler.frames[index];
+}
+
+// the frames from the oldest to the newest, each one is a column with its phases stacked
+static void draw_graph(int x, int y)
+{
+    DrawRectangle(x, y, PROFILER_FRAMES, OVERLAY_GRAPH_HEIGHT, OVERLAY_BG);
+
+    for(size_t age = 0; age < profiler.frames_count; age++) {
+        const ProfilerFrame *frame = get_frame(age);
+        int column_x = x + PROFILER_FRAMES - 1 - age;
+        float bottom = y + OVERLAY_GRAPH_HEIGHT;
+
+        for(int phase = 0; phase < PHASES_COUNT; phase++) {
+            float height = frame->phases[phase] / OVERLAY_GRAPH_MAX_MS * OVERLAY_GRAPH_HEIGHT;
+            if(bottom - height < y) height = bottom - y;
+            if(height <= 0) continue;
+
+            DrawRectangle(column_x, bottom - height, 1, height + 1, phase_colors[phase]);
+            bottom -= height;
+        }
+    }
+
+    // the 60 fps budget
+    int budget_y = y + OVERLAY_GRAPH_HEIGHT - 16.6f / OVERLAY_GRAPH_MAX_MS * OVERLAY_GRAPH_HEIGHT;
+    DrawLine(x, budget_y, x + PROFILER_FRAMES, budget_y, RED);
+}
+
+void profiler_draw_overlay(int screen_width)
+{
+    if(!profiler.overlay_visible || profiler.frames_count == 0) return;
+
+    float totals[PROFILER_FRAMES];
+    float averages[PHASES_COUNT] = {0};
+    for(size_t i = 0; i < profiler.frames_count; i++) {
+        totals[i] = profiler.frames[i].total;
+        for(int phase = 0; phase < PHASES_COUNT; phase++) {
+            averages[phase] += profiler.frames[i].phases[phase] / profiler.frames_count;
+        }
+    }
+    Samples samples = { .items = totals, .count = profiler.frames_count };
+
+    int width = PROFILER_FRAMES + OVERLAY_PADDING * 2;
+    int height = OVERLAY_GRAPH_HEIGHT + OVERLAY_PADDING * 3 + OVERLAY_LINE_HEIGHT * (PHASES_COUNT + 3);
+    int x = screen_width - width - OVERLAY_MARGIN;
+    int y = OVERLAY_MARGIN;
+
+    DrawRectangle(x, y, width, height, OVERLAY_BG);
+    x += OVERLAY_PADDING;
+    y += OVERLAY_PADDING;
+
+    DrawText(TextFormat("frame: p50 %.2f ms | p95 %.2f ms | p99 %.2f ms | max %.2f ms (%zu frames)",
+                        samples_percentile(&samples, 50), samples_percentile(&samples, 95),
+                        samples_percentile(&samples, 99), samples_max(&samples), profiler.frames_count),
+             x, y, OVERLAY_FONT_SIZE, WHITE);
+    y += OVERLAY_LINE_HEIGHT;
+
+    draw_graph(x, y);
+    y += OVERLAY_GRAPH_HEIGHT + OVERLAY_PADDING;
+
+    const ProfilerFrame *last = get_frame(0);
+    for(int phase = 0; phase < PHASES_COUNT; phase++) {
+        DrawRectangle(x, y + 2, OVERLAY_FONT_SIZE - 2, OVERLAY_FONT_SIZE - 2, phase_colors[phase]);
+        DrawText(TextFormat("%-12s last %6.2f ms | avg %6.2f ms", phase_names[phase], last->phases[phase], averages[phase]),
+                 x + OVERLAY_FONT_SIZE + 4, y, OVERLAY_FONT_SIZE, WHITE);
+        y += OVERLAY_LINE_HEIGHT;
+    }
+
+    y += OVERLAY_PADDING;
+    for(int counter = 0; counter < COUNTERS_COUNT; counter++) {
+        const char *text = TextFormat("%s: %zu", counter_names[counter], last->counters[counter]);
+        // two counters per line
+        int column_x = x + (counter % 2) * (PROFILER_FRAMES / 2);
+        DrawText(text, column_x, y, OVERLAY_FONT_SIZE, WHITE);
+        if(counter % 2 == 1) y += OVERLAY_LINE_HEIGHT;
+    }
+}
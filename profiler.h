@@ -0,0 +1,39 @@
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#include <stddef.h>
+
+// number of frames kept to compute the percentiles and draw the graph
+#define PROFILER_FRAMES 600
+
+enum ProfilerPhase {
+    PHASE_INPUT,
+    PHASE_LAYOUT, // walking the nodes, minus the time spent in the other phases
+    PHASE_MEASURE_TEXT,
+    PHASE_DRAW_TEXT,
+    PHASE_IMAGES, // polling the loader, uploading and drawing the textures
+    PHASE_PRESENT, // EndDrawing, which swaps the buffers and waits for the next frame
+    PHASES_COUNT,
+};
+
+enum ProfilerCounter {
+    COUNTER_NODES_VISITED,
+    COUNTER_NODES_DRAWN,
+    COUNTER_MEASURE_TEXT,
+    COUNTER_DRAW_TEXT,
+    COUNTER_ALLOCATIONS,
+    COUNTERS_COUNT,
+};
+
+// these should only be called from the render thread
+void profiler_begin_frame();
+// the time is counted only for the innermost phase, so measuring text while
+// doing the layout doesn't count as layout
+void profiler_push(enum ProfilerPhase phase);
+void profiler_pop();
+void profiler_count(enum ProfilerCounter counter);
+
+void profiler_toggle_overlay();
+void profiler_draw_overlay(int screen_width);
+
+#endif
@@ -0,0 +1,75 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "scroll_bench.h"
+#include "lexer.h"
+
+bool scroll_bench_step(ScrollBench *bench, Vector2 *camera_pos, float document_height, int screen_height)
+{
+    double now = GetTime();
+    if(bench->last_frame_time > 0) {
+        da_append(&bench->frame_times, (now - bench->last_frame_time) * 1000);
+    }
+    bench->last_frame_time = now;
+    bench->document_height = document_height;
+
+    // the first frame hasn't been laid out yet
+    if(document_height <= 0) return true;
+
+    float bottom = document_height > screen_height ? document_height - screen_height : 0;
+
+    switch(bench->stage) {
+        case SCROLL_BENCH_SCROLLING: {
+            camera_pos->y -= SCROLL_BENCH_SPEED;
+
+            if(-camera_pos->y >= bottom) {
+                camera_pos->y = 0;
+                bench->stage = SCROLL_BENCH_JUMPING;
+            }
+        } break;
+        case SCROLL_BENCH_JUMPING: {
+            if(-camera_pos->y >= bottom) {
+                bench->stage = SCROLL_BENCH_DONE;
+            } else {
+                camera_pos->y -= screen_height;
+            }
+        } break;
+        case SCROLL_BENCH_DONE: break;
+    }
+
+    return bench->stage != SCROLL_BENCH_DONE;
+}
+
+bool scroll_bench_write_json(ScrollBench *bench, const char *path)
+{
+    bool to_stdout = strcmp(path, "-") == 0;
+    FILE *file = to_stdout ? stdout : fopen(path, "w");
+
+    if(file == NULL) {
+        TraceLog(LOG_ERROR, "Couldn't open file %s: %s", path, strerror(errno));
+        return false;
+    }
+
+    Samples *frame_times = &bench->frame_times;
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"frames\": %zu,\n", frame_times->count);
+    fprintf(file, "  \"document_height\": %.0f,\n", bench->document_height);
+    fprintf(file, "  \"min_ms\": %.3f,\n", samples_min(frame_times));
+    fprintf(file, "  \"avg_ms\": %.3f,\n", samples_mean(frame_times));
+    fprintf(file, "  \"p50_ms\": %.3f,\n", samples_percentile(frame_times, 50));
+    fprintf(file, "  \"p95_ms\": %.3f,\n", samples_percentile(frame_times, 95));
+    fprintf(file, "  \"p99_ms\": %.3f,\n", samples_percentile(frame_times, 99));
+    fprintf(file, "  \"max_ms\": %.3f,\n", samples_max(frame_times));
+    fprintf(file, "  \"peak_rss_kb\": %ld\n", get_peak_rss_kb());
+    fprintf(file, "}\n");
+
+    if(!to_stdout) fclose(file);
+    return true;
+}
+
+void scroll_bench_destroy(ScrollBench *bench)
+{
+    da_free(&bench->frame_times);
+}
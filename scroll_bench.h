@@ -0,0 +1,32 @@
+#ifndef SCROLL_BENCH_H_
+#define SCROLL_BENCH_H_
+
+#include <stdbool.h>
+#include "raylib.h"
+#include "stats.h"
+
+// pixels scrolled every frame, it doesn't depend on the frame time so every
+// run draws the same frames
+#define SCROLL_BENCH_SPEED 40
+
+enum ScrollBenchStage {
+    SCROLL_BENCH_SCROLLING, // from the top to the bottom at a fixed speed
+    SCROLL_BENCH_JUMPING, // from the top to the bottom one page per frame
+    SCROLL_BENCH_DONE,
+};
+
+typedef struct ScrollBench {
+    enum ScrollBenchStage stage;
+    Samples frame_times;
+    double last_frame_time;
+    float document_height;
+} ScrollBench;
+
+// moves the camera for the next frame, returns false once the script is over,
+// the height of the document is the one of the last frame
+bool scroll_bench_step(ScrollBench *bench, Vector2 *camera_pos, float document_height, int screen_height);
+// writes the results to the path, or to stdout when it's "-"
+bool scroll_bench_write_json(ScrollBench *bench, const char *path);
+void scroll_bench_destroy(ScrollBench *bench);
+
+#endif
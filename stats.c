@@ -0,0 +1,99 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include "raylib.h"
+#include "lexer.h"
+#include "stats.h"
+
+static int compare_floats(const void *a, const void *b)
+{
+    float fa = *(const float *)a;
+    float fb = *(const float *)b;
+    return (fa > fb) - (fa < fb);
+}
+
+void samples_push_window(Samples *samples, float value, size_t window)
+{
+    if(samples->count < window) {
+        da_append(samples, value);
+    } else {
+        samples->items[samples->pushed % window] = value;
+    }
+
+    samples->pushed++;
+}
+
+float samples_percentile(const Samples *samples, float percentile)
+{
+    if(samples->count == 0) return 0;
+
+    float *sorted = malloc(samples->count * sizeof(float));
+    if(sorted == NULL) {
+        TraceLog(LOG_ERROR, "Couldn't allocate memory to sort the samples");
+        return 0;
+    }
+
+    memcpy(sorted, samples->items, samples->count * sizeof(float));
+    qsort(sorted, samples->count, sizeof(float), compare_floats);
+
+    // nearest-rank method
+    size_t rank = (size_t)(percentile / 100.0f * samples->count + 0.5f);
+    if(rank > 0) rank--;
+    if(rank >= samples->count) rank = samples->count - 1;
+
+    float value = sorted[rank];
+    free(sorted);
+
+    return value;
+}
+
+float samples_min(const Samples *samples)
+{
+    if(samples->count == 0) return 0;
+
+    float min = samples->items[0];
+    for(size_t i = 1; i < samples->count; i++) {
+        if(samples->items[i] < min) min = samples->items[i];
+    }
+    return min;
+}
+
+float samples_max(const Samples *samples)
+{
+    float max = 0;
+    for(size_t i = 0; i < samples->count; i++) {
+        if(samples->items[i] > max) max = samples->items[i];
+    }
+    return max;
+}
+
+float samples_mean(const Samples *samples)
+{
+    if(samples->count == 0) return 0;
+
+    double sum = 0;
+    for(size_t i = 0; i < samples->count; i++) {
+        sum += samples->items[i];
+    }
+    return sum / samples->count;
+}
+
+void log_frame_times(const Samples *frame_times)
+{
+    TraceLog(LOG_INFO, "FRAME: last %zu of %zu frames | p50 %.2f ms | p95 %.2f ms | p99 %.2f ms | max %.2f ms",
+             frame_times->count,
+             frame_times->pushed,
+             samples_percentile(frame_times, 50),
+             samples_percentile(frame_times, 95),
+             samples_percentile(frame_times, 99),
+             samples_max(frame_times));
+}
+
+long get_peak_rss_kb()
+{
+    // ru_maxrss is in kilobytes on linux
+    struct rusage usage = {0};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
@@ -0,0 +1,30 @@
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <stddef.h>
+
+// frames kept by the viewer to log the frame times when it's closed, the
+// oldest ones are dropped so a long session doesn't keep growing
+#define FRAME_TIMES_WINDOW (60 * 60 * 5)
+
+typedef struct Samples {
+    float *items;
+    size_t count;
+    size_t capacity;
+    // every sample pushed to the window, including the dropped ones
+    size_t pushed;
+} Samples;
+
+// keeps only the last window samples, the new ones overwrite the oldest
+void samples_push_window(Samples *samples, float value, size_t window);
+
+// percentile should be between 0 and 100
+float samples_percentile(const Samples *samples, float percentile);
+float samples_min(const Samples *samples);
+float samples_max(const Samples *samples);
+float samples_mean(const Samples *samples);
+void log_frame_times(const Samples *frame_times);
+// peak resident memory of the process in kilobytes
+long get_peak_rss_kb();
+
+#endif
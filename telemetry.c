@@ -0,0 +1,144 @@
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "raylib.h"
+#include "telemetry.h"
+
+// the bucket i has the values lower than 2^i, and the first one only has zeros
+#define HISTOGRAM_BUCKETS 48
+
+typedef struct Histogram {
+    atomic_uint_fast64_t buckets[HISTOGRAM_BUCKETS];
+    atomic_uint_fast64_t count;
+    atomic_uint_fast64_t sum;
+    atomic_uint_fast64_t max;
+} Histogram;
+
+typedef struct MetricInfo {
+    const char *name;
+    const char *unit;
+} MetricInfo;
+
+static const MetricInfo metrics_info[TELEMETRY_METRICS_COUNT] = {
+    [TELEMETRY_DNS] = { "dns", "us" },
+    [TELEMETRY_CONNECT] = { "connect", "us" },
+    [TELEMETRY_TLS] = { "tls", "us" },
+    [TELEMETRY_WAIT] = { "wait", "us" },
+    [TELEMETRY_TRANSFER] = { "transfer", "us" },
+    [TELEMETRY_FETCH] = { "fetch", "us" },
+    [TELEMETRY_BYTES] = { "bytes", "B" },
+    [TELEMETRY_DECODE] = { "decode", "us" },
+    [TELEMETRY_UPLOAD] = { "upload", "us" },
+    [TELEMETRY_LOAD] = { "load", "us" },
+};
+
+static Histogram histograms[TELEMETRY_METRICS_COUNT] = {0};
+
+static size_t get_bucket(uint64_t value)
+{
+    size_t bucket = 0;
+    while(value > 0 && bucket < HISTOGRAM_BUCKETS - 1) {
+        value >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+static uint64_t get_bucket_limit(size_t bucket)
+{
+    return bucket == 0 ? 0 : ((uint64_t)1 << bucket) - 1;
+}
+
+void telemetry_record(enum TelemetryMetric metric, uint64_t value)
+{
+    Histogram *histogram = &histograms[metric];
+
+    atomic_fetch_add_explicit(&histogram->buckets[get_bucket(value)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->sum, value, memory_order_relaxed);
+
+    uint64_t max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+    while(value > max && !atomic_compare_exchange_weak(&histogram->max, &max, value));
+}
+
+// the histogram only knows the bucket of every value, so this returns the
+// upper limit of the bucket where the percentile falls
+static uint64_t histogram_percentile(Histogram *histogram, float percentile)
+{
+    uint64_t count = histogram->count;
+    if(count == 0) return 0;
+
+    uint64_t rank = (uint64_t)(percentile / 100.0f * count + 0.5f);
+    if(rank == 0) rank = 1;
+
+    uint64_t seen = 0;
+    for(size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->buckets[i];
+        if(seen < rank) continue;
+
+        uint64_t limit = get_bucket_limit(i);
+        return limit < histogram->max ? limit : histogram->max;
+    }
+
+    return histogram->max;
+}
+
+void telemetry_log()
+{
+    for(size_t i = 0; i < TELEMETRY_METRICS_COUNT; i++) {
+        Histogram *histogram = &histograms[i];
+        if(histogram->count == 0) continue;
+
+        const MetricInfo *info = &metrics_info[i];
+        TraceLog(LOG_INFO, "TELEMETRY: %-8s | %5llu samples | mean %llu %s | p50 <= %llu %s | p95 <= %llu %s | max %llu %s",
+                 info->name, (unsigned long long)histogram->count,
+                 (unsigned long long)(histogram->sum / histogram->count), info->unit,
+                 (unsigned long long)histogram_percentile(histogram, 50), info->unit,
+                 (unsigned long long)histogram_percentile(histogram, 95), info->unit,
+                 (unsigned long long)histogram->max, info->unit);
+    }
+}
+
+bool telemetry_write_json(const char *path)
+{
+    FILE *file = fopen(path, "w");
+    if(file == NULL) {
+        TraceLog(LOG_ERROR, "Couldn't open file %s: %s", path, strerror(errno));
+        return false;
+    }
+
+    fprintf(file, "{\n");
+    for(size_t i = 0; i < TELEMETRY_METRICS_COUNT; i++) {
+        Histogram *histogram = &histograms[i];
+        const MetricInfo *info = &metrics_info[i];
+
+        fprintf(file, "  \"%s\": {\"unit\": \"%s\", \"count\": %llu, \"sum\": %llu, \"max\": %llu, "
+                      "\"p50\": %llu, \"p95\": %llu, \"p99\": %llu, \"buckets\": [",
+                info->name, info->unit,
+                (unsigned long long)histogram->count,
+                (unsigned long long)histogram->sum,
+                (unsigned long long)histogram->max,
+                (unsigned long long)histogram_percentile(histogram, 50),
+                (unsigned long long)histogram_percentile(histogram, 95),
+                (unsigned long long)histogram_percentile(histogram, 99));
+
+        // only the buckets with values, as [upper limit, count] pairs
+        bool first = true;
+        for(size_t j = 0; j < HISTOGRAM_BUCKETS; j++) {
+            if(histogram->buckets[j] == 0) continue;
+
+            fprintf(file, "%s[%llu, %llu]", first ? "" : ", ",
+                    (unsigned long long)get_bucket_limit(j),
+                    (unsigned long long)histogram->buckets[j]);
+            first = false;
+        }
+
+        fprintf(file, "]}%s\n", i + 1 < TELEMETRY_METRICS_COUNT ? "," : "");
+    }
+    fprintf(file, "}\n");
+
+    fclose(file);
+    return true;
+}
@@ -0,0 +1,27 @@
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// every step of the image pipeline, the times are in microseconds
+enum TelemetryMetric {
+    TELEMETRY_DNS,
+    TELEMETRY_CONNECT,
+    TELEMETRY_TLS,
+    TELEMETRY_WAIT, // from the request being sent to the first byte of the response
+    TELEMETRY_TRANSFER,
+    TELEMETRY_FETCH, // the whole transfer, including the steps above
+    TELEMETRY_BYTES,
+    TELEMETRY_DECODE,
+    TELEMETRY_UPLOAD,
+    TELEMETRY_LOAD, // from the image being requested to its texture being ready
+    TELEMETRY_METRICS_COUNT,
+};
+
+// can be called from any thread
+void telemetry_record(enum TelemetryMetric metric, uint64_t value);
+void telemetry_log();
+bool telemetry_write_json(const char *path);
+
+#endif
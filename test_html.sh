@@ -0,0 +1,54 @@
+#!/bin/bash
+# converts small documents with --to-html and checks the generated html
+# usage: ./test_html.sh
+
+./build.sh || exit 1
+
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+FAILED=0
+
+# check <name> <markdown> <expected html>
+# the expected html has to be found in the body of the converted document
+check() {
+    local name=$1 markdown=$2 expected=$3
+
+    mkdir -p "$WORK_DIR/$name/in"
+    printf '%s\n' "$markdown" > "$WORK_DIR/$name/in/$name.md"
+
+    if ! ./build/main --to-html "$WORK_DIR/$name/out" "$WORK_DIR/$name/in" > /dev/null 2>&1; then
+        echo "FAIL $name: the conversion failed"
+        FAILED=1
+        return
+    fi
+
+    local body
+    body=$(sed -n '/<body>/,/<\/body>/p' "$WORK_DIR/$name/out/$name.html" | tr -d '\n')
+
+    if [[ "$body" == *"$expected"* ]]; then
+        echo "ok   $name"
+    else
+        echo "FAIL $name: expected $expected in"
+        echo "$body"
+        FAILED=1
+    fi
+}
+
+check ordered-list \
+    $'1. one\n2. two' \
+    '<ol><li>one</li><li>two</li></ol>'
+
+check ordered-list-start \
+    $'3. three\n4. four' \
+    '<ol start="3"><li>three</li><li>four</li></ol>'
+
+check ordered-list-start-zero \
+    '0. zero' \
+    '<ol start="0"><li>zero</li></ol>'
+
+check nested-ordered-list-start \
+    $'* item\n  7. seven' \
+    '<ul><li>item<ol start="7"><li>seven</li></ol></li></ul>'
+
+exit $FAILED
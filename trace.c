@@ -0,0 +1,238 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "raylib.h"
+#include "trace.h"
+
+#define TRACE_CHUNK_EVENTS 1024
+#define TRACE_THREAD_NAME_SIZE 32
+
+typedef struct TraceEvent {
+    uint64_t time; // nanoseconds since the trace started
+    const char *name;
+    uint64_t id; // only used by the async spans
+    char phase; // the "ph" of the chrome format
+    char detail[TRACE_DETAIL_SIZE];
+} TraceEvent;
+
+typedef struct TraceChunk {
+    TraceEvent events[TRACE_CHUNK_EVENTS];
+    size_t count;
+    struct TraceChunk *next;
+} TraceChunk;
+
+// only written by its thread, the buffers are read once all the threads are done
+typedef struct TraceBuffer {
+    pid_t tid;
+    char thread_name[TRACE_THREAD_NAME_SIZE];
+    TraceChunk *head;
+    TraceChunk *tail;
+    struct TraceBuffer *next;
+} TraceBuffer;
+
+typedef struct Trace {
+    uint64_t start;
+    // every thread pushes its buffer here the first time it records something
+    _Atomic(TraceBuffer *) buffers;
+} Trace;
+
+bool trace_enabled = false;
+static Trace trace = {0};
+static _Thread_local TraceBuffer *thread_buffer = NULL;
+
+static uint64_t get_time_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void trace_start()
+{
+    trace.start = get_time_ns();
+    trace_enabled = true;
+}
+
+static TraceBuffer *get_thread_buffer()
+{
+    if(thread_buffer != NULL) return thread_buffer;
+
+    TraceBuffer *buffer = calloc(1, sizeof(TraceBuffer));
+    if(buffer == NULL) return NULL;
+
+    buffer->tid = gettid();
+
+    buffer->next = atomic_load(&trace.buffers);
+    while(!atomic_compare_exchange_weak(&trace.buffers, &buffer->next, buffer));
+
+    thread_buffer = buffer;
+    return buffer;
+}
+
+static TraceEvent *push_event(char phase, const char *name)
+{
+    uint64_t time = get_time_ns();
+
+    TraceBuffer *buffer = get_thread_buffer();
+    if(buffer == NULL) return NULL;
+
+    if(buffer->tail == NULL || buffer->tail->count == TRACE_CHUNK_EVENTS) {
+        TraceChunk *chunk = malloc(sizeof(TraceChunk));
+        if(chunk == NULL) return NULL;
+
+        chunk->count = 0;
+        chunk->next = NULL;
+
+        if(buffer->tail == NULL) {
+            buffer->head = chunk;
+        } else {
+            buffer->tail->next = chunk;
+        }
+        buffer->tail = chunk;
+    }
+
+    TraceEvent *event = &buffer->tail->events[buffer->tail->count++];
+    event->time = time - trace.start;
+    event->name = name;
+    event->phase = phase;
+    event->id = 0;
+    event->detail[0] = '\0';
+
+    return event;
+}
+
+static void set_detail(TraceEvent *event, const char *detail)
+{
+    if(event != NULL && detail != NULL) {
+        snprintf(event->detail, sizeof(event->detail), "%s", detail);
+    }
+}
+
+void trace_set_thread_name(const char *name)
+{
+    if(!trace_enabled) return;
+
+    TraceBuffer *buffer = get_thread_buffer();
+    if(buffer != NULL) snprintf(buffer->thread_name, sizeof(buffer->thread_name), "%s", name);
+}
+
+void trace_begin_span(const char *name, const char *detail)
+{
+    set_detail(push_event('B', name), detail);
+}
+
+void trace_end_span()
+{
+    push_event('E', NULL);
+}
+
+void trace_begin_async_span(const char *name, uint64_t id, const char *detail)
+{
+    TraceEvent *event = push_event('b', name);
+    if(event == NULL) return;
+
+    event->id = id;
+    set_detail(event, detail);
+}
+
+void trace_end_async_span(const char *name, uint64_t id)
+{
+    TraceEvent *event = push_event('e', name);
+    if(event != NULL) event->id = id;
+}
+
+static void write_json_string(FILE *file, const char *str)
+{
+    fputc('"', file);
+    for(; *str; str++) {
+        unsigned char c = *str;
+
+        if(c == '"' || c == '\\') {
+            fprintf(file, "\\%c", c);
+        } else if(c < 0x20) {
+            fprintf(file, "\\u%04x", c);
+        } else {
+            fputc(c, file);
+        }
+    }
+    fputc('"', file);
+}
+
+bool trace_write_json(const char *path)
+{
+    FILE *file = fopen(path, "w");
+    if(file == NULL) {
+        TraceLog(LOG_ERROR, "Couldn't open file %s: %s", path, strerror(errno));
+        return false;
+    }
+
+    pid_t pid = getpid();
+    size_t events_count = 0;
+
+    fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    for(TraceBuffer *buffer = trace.buffers; buffer != NULL; buffer = buffer->next) {
+        fprintf(file, "%s{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": %d, \"tid\": %d, \"args\": {\"name\": ",
+                events_count > 0 ? ",\n" : "", pid, buffer->tid);
+        write_json_string(file, buffer->thread_name[0] ? buffer->thread_name : "thread");
+        fprintf(file, "}}");
+        events_count++;
+
+        for(TraceChunk *chunk = buffer->head; chunk != NULL; chunk = chunk->next) {
+            for(size_t i = 0; i < chunk->count; i++) {
+                TraceEvent *event = &chunk->events[i];
+
+                fprintf(file, ",\n{\"ph\": \"%c\", \"ts\": %.3f, \"pid\": %d, \"tid\": %d",
+                        event->phase, event->time / 1000.0, pid, buffer->tid);
+
+                if(event->name != NULL) {
+                    fprintf(file, ", \"name\": ");
+                    write_json_string(file, event->name);
+                }
+                if(event->phase == 'b' || event->phase == 'e') {
+                    fprintf(file, ", \"cat\": \"image\", \"id\": \"0x%llx\"", (unsigned long long)event->id);
+                }
+                if(event->detail[0]) {
+                    fprintf(file, ", \"args\": {\"detail\": ");
+                    write_json_string(file, event->detail);
+                    fprintf(file, "}");
+                }
+
+                fprintf(file, "}");
+                events_count++;
+            }
+        }
+    }
+    fprintf(file, "\n]}\n");
+
+    fclose(file);
+    TraceLog(LOG_INFO, "TRACE: %zu events written to %s", events_count, path);
+
+    return true;
+}
+
+void trace_destroy()
+{
+    TraceBuffer *buffer = atomic_exchange(&trace.buffers, NULL);
+
+    while(buffer != NULL) {
+        TraceChunk *chunk = buffer->head;
+        while(chunk != NULL) {
+            TraceChunk *next = chunk->next;
+            free(chunk);
+            chunk = next;
+        }
+
+        TraceBuffer *next = buffer->next;
+        free(buffer);
+        buffer = next;
+    }
+
+    thread_buffer = NULL;
+    trace_enabled = false;
+}
@@ -0,0 +1,37 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// the detail of a span (usually an url) is truncated to this size
+#define TRACE_DETAIL_SIZE 128
+
+// nothing is recorded until trace_start is called, the macros below check
+// this first so a disabled trace only costs a branch
+extern bool trace_enabled;
+
+// has to be called before starting the other threads
+void trace_start();
+// every thread records its spans in its own buffer, these can be called
+// from any thread and never take a lock
+void trace_set_thread_name(const char *name);
+// the name has to be a string literal, the detail is copied
+void trace_begin_span(const char *name, const char *detail);
+void trace_end_span();
+// spans that overlap in the same thread, like the downloads, are matched by id
+void trace_begin_async_span(const char *name, uint64_t id, const char *detail);
+void trace_end_async_span(const char *name, uint64_t id);
+
+#define trace_begin(name) do { if(trace_enabled) trace_begin_span(name, NULL); } while(0)
+#define trace_begin_detail(name, detail) do { if(trace_enabled) trace_begin_span(name, detail); } while(0)
+#define trace_end() do { if(trace_enabled) trace_end_span(); } while(0)
+#define trace_begin_async(name, id, detail) do { if(trace_enabled) trace_begin_async_span(name, id, detail); } while(0)
+#define trace_end_async(name, id) do { if(trace_enabled) trace_end_async_span(name, id); } while(0)
+
+// writes the chrome trace event format, it can be opened in chrome://tracing
+// or https://ui.perfetto.dev, the other threads have to be stopped by then
+bool trace_write_json(const char *path);
+void trace_destroy();
+
+#endif